@@ -37,11 +37,10 @@ namespace quantas {
 	}
 
 	void AltBitPeer::performComputation() {
-		while (!inStreamEmpty()) {
+		drainInStream([this](Packet&& packet) {
 			// std::cout << publicId() << " received a message" << std::endl;
-			Packet packet = popInStream();
 			interfaceId source = packet.sourceId();
-			json oldMessage = packet.getMessage();
+			json oldMessage = packet.takeMessage();
 			if (oldMessage["action"] == "ack") {
 				if (oldMessage["messageNum"] == ns) {
 					previousMessageRound = RoundManager::currentRound();
@@ -58,7 +57,7 @@ namespace quantas {
 				newMessage["action"] = "ack";
 				sendMessage(0, newMessage);
 			}
-		}
+		});
 
 		if (messagesSent == 0 && publicId() == 0) {
 			submitTrans(currentTransaction);
@@ -13,6 +13,7 @@ QUANTAS. If not, see <https://www.gnu.org/licenses/>.
 */
 
 #include <algorithm>
+#include <cstdint>
 #include <deque>
 #include <functional>
 #include <limits>
@@ -37,6 +38,11 @@ static bool registerBitcoinPeer = []() {
         [](interfaceId pubId) { return new BitcoinPeer(new NetworkInterfaceAbstract(pubId)); });
 }();
 
+// Transactions are sent as typed payloads; the json form is only built for faults.
+const messageTag BitcoinPeer::transactionTag =
+    MessageRegistry::registerMessageType<BitcoinPeer::PendingTx>(
+        "BitcoinTransaction", &BitcoinPeer::buildTransactionMessage);
+
 BitcoinPeer::BitcoinPeer(NetworkInterface* interfacePtr)
     : PoWPeer(interfacePtr) {}
 
@@ -60,7 +66,7 @@ void BitcoinPeer::runProtocolStep(const std::vector<std::string>& overrideParent
         PendingTx pending = makeTransaction();
         _queue.push_back(pending);
         _knownTransactions.insert({pending.submitter, pending.id});
-        broadcast(buildTransactionMessage(pending));
+        broadcastPayload(Payload(pending));
     }
 
     if (!guardMine()) return;
@@ -403,27 +409,29 @@ void BitcoinPeer::checkInStrm() {
 
     while (!inStreamEmpty()) {
         Packet packet = popInStream();
-        json msg = packet.getMessage();
+        if (packet.getPayload().holds<PendingTx>()) {
+            acceptTransaction(packet.getPayload().get<PendingTx>());
+            continue;
+        }
+        const json& msg = packet.message();
         if (!msg.contains("type") || msg["type"] != "PoW") continue;
 
         const std::string messageType = msg.value("messageType", std::string());
         if (messageType == "transaction") {
             // Cache the transaction locally so we can mine it later.
-            const json& txJson = msg["transaction"];
-            int txId = txJson.value("id", -1);
-            interfaceId submitter = txJson.value("submitter", msg.value("from_id", NO_PEER_ID));
-            if (txId < 0 || submitter == NO_PEER_ID) continue;
-            std::pair<interfaceId, int> key{submitter, txId};
-            if (_knownTransactions.insert(key).second) {
-                PendingTx pending;
-                pending.id = txId;
-                pending.roundSubmitted = txJson.value("roundSubmitted", -1);
-                pending.submitter = submitter;
-                _queue.push_back(pending);
-            }
+            auto txEntry = msg.find("transaction");
+            if (txEntry == msg.end() || !txEntry->is_object()) continue;
+            const json& txJson = *txEntry;
+            PendingTx pending;
+            pending.id = txJson.value("id", -1);
+            pending.roundSubmitted = txJson.value("roundSubmitted", -1);
+            pending.submitter = txJson.value("submitter", msg.value("from_id", NO_PEER_ID));
+            acceptTransaction(pending);
         } else if (messageType == "block") {
             // Import the announced block so our local view stays in sync with the network.
-            const json& blkJson = msg["block"];
+            auto blkEntry = msg.find("block");
+            if (blkEntry == msg.end() || !blkEntry->is_object()) continue;
+            const json& blkJson = *blkEntry;
             std::string hash = blkJson.value("hash", std::string());
 
             std::vector<std::string> parents;
@@ -436,7 +444,7 @@ void BitcoinPeer::checkInStrm() {
             const interfaceId miner = blkJson.value("miner", NO_PEER_ID);
             const int minedRound = blkJson.value("roundMined", static_cast<int>(RoundManager::currentRound()));
             if (hash.empty()) {
-                hash = std::to_string(miner) + ":" + parents.front();
+                hash = std::to_string(miner) + ":" + (parents.empty() ? std::string("GENESIS") : parents.front());
             }
 
             // Log the block metadata exactly as advertised; parasite flags are passed through for visibility only.
@@ -466,18 +474,57 @@ void BitcoinPeer::checkInStrm() {
     }
 }
 
-bool BitcoinPeer::guardSubmit() const {
+// Queue a transaction we have not seen before.
+void BitcoinPeer::acceptTransaction(const PendingTx& pending) {
+    if (pending.id < 0 || pending.submitter == NO_PEER_ID) return;
+    std::pair<interfaceId, int> key{pending.submitter, pending.id};
+    if (_knownTransactions.insert(key).second) {
+        _queue.push_back(pending);
+    }
+}
+
+bool BitcoinPeer::guardSubmit() {
     // Simple Bernoulli trial used by the simulator to throttle transaction volume.
-    return submitRate > 0 && randMod(submitRate) == 0;
+    if (submitRate <= 0) return false;
+    return scheduledTrial(_nextSubmitRound, 1.0 / submitRate);
 }
 
 
-bool BitcoinPeer::guardMine() const {
+bool BitcoinPeer::guardMine() {
     if (_mineRate <= 0) return false;
     if (_mineDenominator <= 0) return false;
-    if (_queue.empty()) return false;
     // Mining success probability is _mineRate / _mineDenominator as described in the spec.
-    return randMod(_mineDenominator) < _mineRate;
+    // The trial runs even with an empty queue so the schedule does not depend on it.
+    bool success = scheduledTrial(_nextMineRound, static_cast<double>(_mineRate) / _mineDenominator);
+    return success && !_queue.empty();
+}
+
+// A Bernoulli trial every round is drawn as the geometric gap to the next success
+// instead, so rounds in between can be skipped without changing the distribution.
+bool BitcoinPeer::scheduledTrial(size_t& nextRound, double probability) {
+    if (probability <= 0.0) return false;
+    probability = std::min(probability, 1.0);
+    const size_t round = RoundManager::currentRound();
+    if (nextRound == 0 || nextRound < round) {
+        // first draw, or the scheduled round was missed (e.g. while crashed)
+        nextRound = round - 1 + geometricInt(probability);
+    }
+    if (nextRound != round) return false;
+    nextRound = round + geometricInt(probability);
+    return true;
+}
+
+size_t BitcoinPeer::nextWakeRound() const {
+    if (!pow()) return SIZE_MAX; // never configured, runProtocolStep is a no-op
+    const size_t next = RoundManager::currentRound() + 1;
+    size_t wake = SIZE_MAX;
+    if (submitRate > 0) {
+        wake = std::min(wake, _nextSubmitRound == 0 ? next : _nextSubmitRound);
+    }
+    if (_mineRate > 0 && _mineDenominator > 0) {
+        wake = std::min(wake, _nextMineRound == 0 ? next : _nextMineRound);
+    }
+    return std::max(wake, next);
 }
 
 BitcoinPeer::PendingTx BitcoinPeer::makeTransaction() {
@@ -489,7 +536,7 @@ BitcoinPeer::PendingTx BitcoinPeer::makeTransaction() {
     return pending;
 }
 
-json BitcoinPeer::buildTransactionMessage(const PendingTx& pending) const {
+json BitcoinPeer::buildTransactionMessage(const PendingTx& pending) {
     // Transactions are tiny JSON envelopes so other peers can add them to their own queues.
     return json{
         {"type", "PoW"},
@@ -500,7 +547,7 @@ json BitcoinPeer::buildTransactionMessage(const PendingTx& pending) const {
             {"roundSubmitted", pending.roundSubmitted},
             {"submitter", pending.submitter}
         }},
-        {"from_id", publicId()}
+        {"from_id", pending.submitter}
     };
 }
 
@@ -25,8 +25,8 @@ QUANTAS. If not, see <https://www.gnu.org/licenses/>.
 
 namespace quantas {
 
-// Proof-of-Work peer that communicates entirely with JSON messages and relies on
-// PoW for lightweight block bookkeeping.
+// Proof-of-Work peer that announces blocks with JSON messages and transactions
+// with typed payloads, and relies on PoW for lightweight block bookkeeping.
 class BitcoinPeer : public PoWPeer {
 public:
     BitcoinPeer(NetworkInterface* interfacePtr);
@@ -37,22 +37,27 @@ public:
     void runProtocolStep(const std::vector<std::string>& overrideParents = {}) override;
     void initParameters(const std::vector<Peer*>& peers, json parameters) override;
     void endOfRound(std::vector<Peer*>& peers) override;
+    size_t nextWakeRound() const override;
+    bool idleEndOfRound() const override { return true; } // only logs on the last round
 
 private:
-    // Minimal description of a queued transaction
+    // Minimal description of a queued transaction, also sent as a typed message
     struct PendingTx {
         int id = -1;
         int roundSubmitted = -1;
         interfaceId submitter = NO_PEER_ID;
     };
+    static const messageTag transactionTag;
 
     void checkInStrm();
-    bool guardSubmit() const;
-    bool guardMine() const;
+    void acceptTransaction(const PendingTx& pending);
+    bool guardSubmit();
+    bool guardMine();
+    static bool scheduledTrial(size_t& nextRound, double probability);
     std::vector<std::string> getParents(const PoW& group) const;
     PendingTx makeTransaction();
     // turns contents into a sendable json format
-    json buildTransactionMessage(const PendingTx& pending) const;
+    static json buildTransactionMessage(const PendingTx& pending);
     json buildBlockMessage(const PoW::BlockRecord& record,
                            const std::vector<std::string>& parents,
                            int minedRound,
@@ -66,6 +71,8 @@ private:
     std::set<std::pair<interfaceId, int>> _knownTransactions; // all known transactions (kept to ensure consistency with the pending queue)
     int _localSubmitted = 0; // transaction id counter
     int minedBlocks = 0; // total blocks mined by this peer
+    size_t _nextSubmitRound = 0; // next round a transaction is submitted (0 until first drawn)
+    size_t _nextMineRound = 0; // next round a mining attempt succeeds (0 until first drawn)
 };
 
 }
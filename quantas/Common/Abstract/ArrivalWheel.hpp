@@ -0,0 +1,142 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under
+the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+QUANTAS is distributed in the hope that it will be useful, but
+WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// A timing wheel of inbound channels (edge ids in the network's ChannelStore)
+// keyed by the round they next need to be visited. Channels register themselves when a packet is pushed, so receive()
+// only touches the channels with packets due instead of every inbound channel.
+//
+// The near level is a ring of SLOTS buckets holding the rounds (now, now + SLOTS],
+// one round per bucket. Anything further out waits in an ordered far level and is
+// cascaded into the ring as the wheel advances. Entries are not removed when a
+// channel is rescheduled; the owner drops stale ones when they are collected.
+
+#ifndef ARRIVAL_WHEEL_HPP
+#define ARRIVAL_WHEEL_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace quantas {
+
+// a channel's index in the network's ChannelStore
+typedef uint32_t EdgeId;
+
+class ArrivalWheel {
+public:
+    typedef std::pair<size_t, EdgeId> Entry; // (round, channel)
+
+    // Register ch to be visited in round and return the round actually used
+    // (never one that was already collected). Called by senders during the
+    // computation phase, possibly concurrently.
+    size_t schedule(size_t round, EdgeId ch) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (round <= _now) round = _now + 1;
+        if (round <= _now + SLOTS) {
+            if (!_near) _near.reset(new std::vector<Entry>[SLOTS]);
+            _near[round % SLOTS].emplace_back(round, ch);
+        } else {
+            _far[round].push_back(ch);
+        }
+        ++_size;
+        return round;
+    }
+
+    // Move every entry due in or before round into out and advance the wheel.
+    void collect(size_t round, std::vector<Entry>& out) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (round <= _now) return;
+        if (_size == 0) {
+            _now = round;
+            return;
+        }
+        if (_near) {
+            size_t last = std::min(round, _now + SLOTS);
+            for (size_t r = _now + 1; r <= last; ++r) {
+                std::vector<Entry>& slot = _near[r % SLOTS];
+                if (slot.empty()) continue;
+                _size -= slot.size();
+                out.insert(out.end(), slot.begin(), slot.end());
+                slot.clear();
+            }
+        }
+        // far entries that came due, possibly after a jump of several rounds
+        auto it = _far.begin();
+        for (; it != _far.end() && it->first <= round; ++it) {
+            for (EdgeId ch : it->second) out.emplace_back(it->first, ch);
+            _size -= it->second.size();
+        }
+        _far.erase(_far.begin(), it);
+        _now = round;
+
+        // cascade the far entries now inside the ring
+        for (it = _far.begin(); it != _far.end() && it->first <= _now + SLOTS; ++it) {
+            if (!_near) _near.reset(new std::vector<Entry>[SLOTS]);
+            for (EdgeId ch : it->second) _near[it->first % SLOTS].emplace_back(it->first, ch);
+        }
+        _far.erase(_far.begin(), it);
+    }
+
+    // earliest scheduled round (stale entries included), SIZE_MAX when empty
+    size_t nextRound() const {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_size == 0) return SIZE_MAX;
+        if (_near) {
+            for (size_t r = _now + 1; r <= _now + SLOTS; ++r) {
+                if (!_near[r % SLOTS].empty()) return r;
+            }
+        }
+        return _far.empty() ? SIZE_MAX : _far.begin()->first;
+    }
+
+    bool empty() const { return _size == 0; }
+
+    // free the ring buckets once nothing is scheduled
+    void release() {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_size == 0) _near.reset();
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> lock(_mtx);
+        _near.reset();
+        _far.clear();
+        _size = 0;
+        _now = 0;
+    }
+
+private:
+    static constexpr size_t SLOTS = 32;
+
+    // ring buckets, allocated on first use so idle interfaces stay small
+    std::unique_ptr<std::vector<Entry>[]> _near;
+    // rounds beyond the ring
+    std::map<size_t, std::vector<EdgeId>> _far;
+    // last collected round
+    size_t _now{0};
+    size_t _size{0};
+    mutable std::mutex _mtx;
+};
+
+} // end namespace quantas
+
+#endif /* ARRIVAL_WHEEL_HPP */
@@ -1,39 +1,182 @@
 #include "Channel.hpp"
 
- 
+
 namespace quantas {
 
-Channel::Channel(interfaceId targetId, interfaceId targetInternalId,
-                        interfaceId sourceId, interfaceId sourceInternalId,
-                        const nlohmann::json &channelParams)
-: _targetId(targetId),
-  _targetInternalId(targetInternalId),
-  _sourceId(sourceId),
-  _sourceInternalId(sourceInternalId)
-{
-    setParameters(channelParams);
+void ChannelStore::clear() {
+    for (size_t i = 0; i < _pageCount; ++i) {
+        delete _pages[i].load(std::memory_order_relaxed);
+    }
+    _pages.reset();
+    _pageCount = 0;
+    _edgeCount = 0;
+    std::vector<size_t>().swap(_firstOut);
+    std::vector<ArrivalWheel*>().swap(_wheels);
+    _targetLocks.reset();
+    _properties.clear();
+    _topology = nullptr;
+    _throughput = INT_MAX;
+}
+
+void ChannelStore::allocatePages(size_t edgeCount) {
+    if (edgeCount > size_t(UINT32_MAX) + 1) {
+        throw std::length_error("ChannelStore: " + std::to_string(edgeCount) + " channels do not fit in an edge id");
+    }
+    _edgeCount = edgeCount;
+    _pageCount = (edgeCount + PAGE_SIZE - 1) / PAGE_SIZE;
+    _pages.reset(new std::atomic<Page*>[_pageCount]);
+    for (size_t i = 0; i < _pageCount; ++i) {
+        _pages[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+void ChannelStore::reset(std::vector<size_t> firstOut) {
+    clear();
+    allocatePages(firstOut.empty() ? 0 : firstOut.back());
+    for (size_t i = 0; i < _pageCount; ++i) {
+        _pages[i].store(new Page(), std::memory_order_relaxed);
+    }
+    _wheels.assign(firstOut.empty() ? 0 : firstOut.size() - 1, nullptr);
+    _firstOut = std::move(firstOut);
+    allocateLocks();
 }
 
-Channel::~Channel() {
-    while (!_packetQueue.empty()) {
-        _packetQueue.pop_front();
+void ChannelStore::reset(const ImplicitTopology* topology, ChannelProperties* properties, int throughput) {
+    clear();
+    const size_t peerCount = static_cast<size_t>(std::max<interfaceId>(topology->peers(), 0));
+    std::vector<size_t> firstOut(peerCount + 1, 0);
+    for (size_t i = 0; i < peerCount; ++i) {
+        firstOut[i + 1] = firstOut[i] + topology->degree(static_cast<interfaceId>(i));
     }
-};
+    allocatePages(firstOut.back());
+    _wheels.assign(peerCount, nullptr);
+    _firstOut = std::move(firstOut);
+    _properties.push_back(properties);
+    _topology = topology;
+    _throughput = throughput;
+    allocateLocks();
+}
+
+void ChannelStore::setFused(bool fused) {
+    _fused = fused;
+    allocateLocks();
+}
 
-void Channel::setParameters(const nlohmann::json &params) {
-    _properties = ChannelPropertiesFactory::instance().create(params);
-    _throughputLeft = _properties->getMaxMsgsRec()*(RoundManager::lastRound()-RoundManager::currentRound());
+void ChannelStore::allocateLocks() {
+    _targetLocks.reset(_fused && !_wheels.empty() ? new std::mutex[_wheels.size()] : nullptr);
 }
 
-int Channel::computeRandomDelay() const {
+size_t ChannelStore::pagesInUse() const {
+    size_t used = 0;
+    for (size_t i = 0; i < _pageCount; ++i) {
+        if (_pages[i].load(std::memory_order_relaxed) != nullptr) ++used;
+    }
+    return used;
+}
+
+void ChannelStore::rewindPages(size_t begin, size_t end, int rounds) {
+    for (size_t index = begin; index < std::min(end, _pageCount); ++index) {
+        Page* p = _pages[index].load(std::memory_order_relaxed);
+        if (p == nullptr) continue;
+        size_t count = std::min(PAGE_SIZE, _edgeCount - index * PAGE_SIZE);
+        for (size_t i = 0; i < count; ++i) {
+            p->queue[i].clear();
+            p->throughputLeft[i] = _properties[p->propertyIndex[i]]->getMaxMsgsRec() * rounds;
+            p->wakeRound[i] = SIZE_MAX;
+            p->drained[i] = 0;
+            p->open[i] = 1;
+        }
+    }
+}
+
+ChannelStore::Page& ChannelStore::implicitPage(size_t index) const {
+    if (_topology == nullptr || index >= _pageCount) {
+        throw std::out_of_range("ChannelStore: no channel page " + std::to_string(index));
+    }
+    // connect every edge of the page; peers of an implicit network are
+    // numbered by index, so public and internal ids are the index too
+    std::unique_ptr<Page> fresh(new Page());
+    size_t first = index * PAGE_SIZE;
+    size_t last = std::min(first + PAGE_SIZE, _edgeCount);
+    size_t source = static_cast<size_t>(std::upper_bound(_firstOut.begin(), _firstOut.end(), first) - _firstOut.begin()) - 1;
+    for (size_t e = first; e < last; ++e) {
+        while (e >= _firstOut[source + 1]) ++source;
+        interfaceId target = _topology->neighbor(static_cast<interfaceId>(source), e - _firstOut[source]);
+        size_t i = e - first;
+        fresh->targetId[i] = target;
+        fresh->targetIndex[i] = static_cast<uint32_t>(target);
+        fresh->targetInternalId[i] = target;
+        fresh->sourceId[i] = static_cast<interfaceId>(source);
+        fresh->sourceInternalId[i] = static_cast<interfaceId>(source);
+        fresh->propertyIndex[i] = 0;
+        fresh->queue[i].setMaxCapacity(_properties[0]->getSize());
+        fresh->throughputLeft[i] = _throughput;
+        fresh->wakeRound[i] = SIZE_MAX;
+        fresh->drained[i] = 0;
+        fresh->open[i] = 1;
+    }
+    // another thread may have set the page up first
+    Page* expected = nullptr;
+    if (_pages[index].compare_exchange_strong(expected, fresh.get(), std::memory_order_acq_rel)) {
+        return *fresh.release();
+    }
+    return *expected;
+}
+
+uint32_t ChannelStore::propertiesIndex(ChannelProperties* properties) {
+    auto it = std::find(_properties.begin(), _properties.end(), properties);
+    if (it != _properties.end()) return static_cast<uint32_t>(it - _properties.begin());
+    _properties.push_back(properties);
+    return static_cast<uint32_t>(_properties.size() - 1);
+}
+
+void ChannelStore::connect(EdgeId e, uint32_t targetIndex, interfaceId targetId, interfaceId targetInternalId,
+                           interfaceId sourceId, interfaceId sourceInternalId,
+                           uint32_t properties, int throughput) {
+    Page& p = page(e);
+    size_t i = slot(e);
+    p.targetId[i] = targetId;
+    p.targetIndex[i] = targetIndex;
+    p.targetInternalId[i] = targetInternalId;
+    p.sourceId[i] = sourceId;
+    p.sourceInternalId[i] = sourceInternalId;
+    p.propertyIndex[i] = properties;
+    p.queue[i].setMaxCapacity(_properties[properties]->getSize());
+    p.throughputLeft[i] = throughput;
+    p.wakeRound[i] = SIZE_MAX;
+    p.drained[i] = 0;
+    p.open[i] = 1;
+}
+
+std::pair<EdgeId, EdgeId> ChannelStore::findOutbound(uint32_t source, interfaceId targetId) const {
+    EdgeId first = static_cast<EdgeId>(_firstOut[source]);
+    if (_topology != nullptr) {
+        long j = _topology->indexOf(static_cast<interfaceId>(source), targetId);
+        if (j < 0) return {first, first};
+        return {first + static_cast<EdgeId>(j), first + static_cast<EdgeId>(j) + 1};
+    }
+    // binary search for the first edge to targetId and then past the last one
+    EdgeId lo = first, hi = static_cast<EdgeId>(_firstOut[source + 1]);
+    EdgeId end = hi;
+    while (lo < hi) {
+        EdgeId mid = lo + (hi - lo) / 2;
+        if (this->targetId(mid) < targetId) lo = mid + 1; else hi = mid;
+    }
+    EdgeId last = lo;
+    while (last < end && this->targetId(last) == targetId) ++last;
+    return {lo, last};
+}
+
+int ChannelStore::computeRandomDelay(EdgeId e) const {
+    const ChannelProperties& props = properties(e);
     int delay = 1;
-    switch (_properties->getDelayStyle()) {
+    switch (props.getDelayStyle()) {
     case DelayStyle::DS_UNIFORM:
-        delay = uniformInt(_properties->getMinDelay(), _properties->getMaxDelay());
+        delay = uniformInt(props.getMinDelay(), props.getMaxDelay());
         break;
     case DelayStyle::DS_POISSON:
-        delay = poissonInt(_properties->getAvgDelay());
-        delay = std::clamp(delay, _properties->getMinDelay(), _properties->getMaxDelay());
+        delay = poissonInt(props.getAvgDelay());
+        delay = std::clamp(delay, props.getMinDelay(), props.getMaxDelay());
         break;
     case DelayStyle::DS_ONE:
         delay = 1;
@@ -42,42 +185,66 @@ int Channel::computeRandomDelay() const {
     return delay;
 }
 
-void Channel::pushPacket(Packet pkt) {
+void ChannelStore::pushPacket(EdgeId e, Packet pkt) {
+    Page& p = page(e);
+    std::unique_lock<std::mutex> lock = lockTarget(e);
+    const ChannelProperties& props = properties(e);
     // possible drop
-    if (trueWithProbability(_properties->getDropProbability())) {
+    if (trueWithProbability(props.getDropProbability())) {
         return;
     }
 
+    RingBuffer<Packet>& queue = p.queue[slot(e)];
     bool duplicate = false;
 
     do {
         duplicate = false;
-        if (!canSend()) {
+        if (!canSend(e)) {
             return;
         }
 
-        consumeThroughput();
-        int d = computeRandomDelay();
+        consumeThroughput(e);
+        int d = computeRandomDelay(e);
         pkt.setDelay(d, d);
-        _packetQueue.push_back(pkt);
+        queue.push_back(std::move(pkt));
+        scheduleArrival(e);
 
-        duplicate = trueWithProbability(_properties->getDuplicateProbability());
-        if (duplicate) pkt.setMessage(pkt.getMessage());
+        // duplicates share the (immutable) message body
+        duplicate = trueWithProbability(props.getDuplicateProbability());
+        if (duplicate) pkt = queue.back();
 
     } while (duplicate);
 }
 
-void Channel::shuffleChannel() {
-    // reorder
-    if (_packetQueue.size() > 1 && trueWithProbability(_properties->getReorderProbability())) {
-        std::shuffle(_packetQueue.begin(), _packetQueue.end(), threadLocalEngine());
+void ChannelStore::scheduleArrival(EdgeId e) {
+    Page& p = page(e);
+    size_t i = slot(e);
+    ArrivalWheel* arrivals = _wheels[p.targetIndex[i]];
+    if (arrivals == nullptr || p.queue[i].empty()) return;
+    size_t round = std::max(nextEventRound(e), RoundManager::currentRound() + 1);
+    if (round < p.wakeRound[i]) {
+        p.wakeRound[i] = arrivals->schedule(round, e);
+    }
+}
+
+void ChannelStore::shuffleChannel(EdgeId e) {
+    // reorder the packets sent before this round. Those sent in it, only
+    // there when rounds are fused and the source ran first, stay behind, so a
+    // fused round reorders as the two-pass loop does.
+    RingBuffer<Packet>& queue = page(e).queue[slot(e)];
+    auto sent = queue.end();
+    const int round = static_cast<int>(RoundManager::currentRound());
+    while (sent != queue.begin() && (sent - 1)->getRoundSent() >= round) --sent;
+    if (sent - queue.begin() > 1 && trueWithProbability(properties(e).getReorderProbability())) {
+        std::shuffle(queue.begin(), sent, threadLocalEngine());
     }
 }
 
-Packet Channel::popPacket() {
-    Packet p = std::move(_packetQueue.front());
-    _packetQueue.pop_front();
+Packet ChannelStore::popPacket(EdgeId e) {
+    RingBuffer<Packet>& queue = page(e).queue[slot(e)];
+    Packet p = std::move(queue.front());
+    queue.pop_front();
     return p;
 }
 
-} // end namespace quantas
\ No newline at end of file
+} // end namespace quantas
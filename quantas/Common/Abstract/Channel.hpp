@@ -1,8 +1,8 @@
 
 /**
- * This channel stores a queue of packets that are being delivered
+ * A channel stores a queue of packets that are being delivered
  * to the inbound interface. The outbound interface calls pushPacket(...)
- * via its pointer.
+ * with the channel's edge id in the network's ChannelStore.
  */
 
 #ifndef CHANNEL_HPP
@@ -14,12 +14,20 @@
 #include <deque>
 #include <random>
 #include <algorithm>
+#include <atomic>
 #include <stdexcept>
 #include <climits>
+#include <cstdint>
+#include <mutex>
 #include <unordered_set>
+#include <utility>
+#include <vector>
 #include "../Json.hpp"
 #include "../RandomUtil.hpp"
 #include "../Packet.hpp"
+#include "../RingBuffer.hpp"
+#include "../ImplicitTopology.hpp"
+#include "ArrivalWheel.hpp"
 
 namespace quantas {
 
@@ -69,19 +77,26 @@ public:
     struct Hash {
         size_t operator()(const ChannelProperties* props) const {
             size_t h = 0;
-            h ^= std::hash<double>{}(props->getDropProbability());
-            h ^= std::hash<double>{}(props->getReorderProbability());
-            h ^= std::hash<double>{}(props->getDuplicateProbability());
-            h ^= std::hash<int>{}(props->getMaxMsgsRec());
-            h ^= std::hash<int>{}(props->getSize());
-            h ^= std::hash<int>{}(props->getAvgDelay());
-            h ^= std::hash<int>{}(props->getMinDelay());
-            h ^= std::hash<int>{}(props->getMaxDelay());
-            h ^= std::hash<int>{}(static_cast<int>(props->getDelayStyle()));
+            auto combine = [&h](size_t v) { h ^= v + 0x9e3779b97f4a7c15ull + (h << 6) + (h >> 2); };
+            combine(std::hash<double>{}(props->getDropProbability()));
+            combine(std::hash<double>{}(props->getReorderProbability()));
+            combine(std::hash<double>{}(props->getDuplicateProbability()));
+            combine(std::hash<int>{}(props->getMaxMsgsRec()));
+            combine(std::hash<int>{}(props->getSize()));
+            combine(std::hash<int>{}(props->getAvgDelay()));
+            combine(std::hash<int>{}(props->getMinDelay()));
+            combine(std::hash<int>{}(props->getMaxDelay()));
+            combine(std::hash<int>{}(static_cast<int>(props->getDelayStyle())));
             return h;
         }
     };
 
+    struct Equal {
+        bool operator()(const ChannelProperties* a, const ChannelProperties* b) const {
+            return *a == *b;
+        }
+    };
+
     // Getters
     double getDropProbability() const { return dropProbability; }
     double getReorderProbability() const { return reorderProbability; }
@@ -111,14 +126,17 @@ public:
         return instance;
     }
 
+    // Returns the shared instance equal to params; only allocates the first
+    // time a set of properties is seen
     ChannelProperties *create(const json &params) {
-        ChannelProperties *newProps = new ChannelProperties(params);
-        for (auto prop : _propertiesCache) {
-            if (*prop == *newProps) {
-                delete newProps;
-                return prop;
-            }
+        ChannelProperties candidate(params);
+        // shared by every simulation in the process
+        std::lock_guard<std::mutex> lock(_mtx);
+        auto it = _propertiesCache.find(&candidate);
+        if (it != _propertiesCache.end()) {
+            return *it;
         }
+        ChannelProperties *newProps = new ChannelProperties(candidate);
         _propertiesCache.insert(newProps);
         return newProps;
     }
@@ -135,69 +153,230 @@ private:
     ChannelPropertiesFactory(const ChannelPropertiesFactory &) = delete;
     ChannelPropertiesFactory &operator=(const ChannelPropertiesFactory &) = delete;
 
-    std::unordered_set<ChannelProperties*, ChannelProperties::Hash> _propertiesCache;
+    std::unordered_set<ChannelProperties*, ChannelProperties::Hash, ChannelProperties::Equal> _propertiesCache;
+    std::mutex _mtx;
 };
 
-class Channel : public std::enable_shared_from_this<Channel> {
-private:
-    static ChannelPropertiesFactory _propertiesFactory;
+// The channels of a network, one per (source, neighbor) pair, identified by a
+// dense edge id. Channel state is split by field into arrays indexed by edge
+// id, in pages of PAGE_SIZE edges, so channels are not separate heap objects:
+// a send finds the edge in the source's range and then touches a handful of
+// array slots. Edges are numbered source by source and ordered by target
+// within a source, so peer i's outbound edges are [firstOut[i], firstOut[i+1]).
+//
+// An implicit network (see ImplicitTopology) numbers its edges the same way
+// but only sets up a page when a packet is first sent on one of its edges, so
+// memory follows the traffic instead of the number of edges.
+class ChannelStore {
+public:
+    ChannelStore() = default;
+    ChannelStore(const ChannelStore&) = delete;
+    ChannelStore& operator=(const ChannelStore&) = delete;
+    ~ChannelStore() { clear(); }
+
+    // Drops every channel and makes room for the unconnected outbound edges of
+    // firstOut.size() - 1 peers; edges are set up with connect()
+    void reset(std::vector<size_t> firstOut);
+    // Drops every channel; the edges of topology are set up on first use with
+    // the given properties and throughput
+    void reset(const ImplicitTopology* topology, ChannelProperties* properties, int throughput);
+    void clear();
+
+    // Whether rounds are fused (see Network::receiveAndCompute). Only then do
+    // a target and its senders touch an edge at the same time, and the edges
+    // into each peer are guarded by a lock of that peer's.
+    void setFused(bool fused);
+
+    size_t size() const { return _edgeCount; }
+    size_t peers() const { return _wheels.size(); }
+    size_t pageCount() const { return _pageCount; }
+    // pages set up so far
+    size_t pagesInUse() const;
+
+    // Empties the channels of pages [begin, end) and reopens them with the
+    // throughput of rounds rounds, keeping the pages and their queue storage,
+    // so the same network can be run again without connecting every edge.
+    // Pages not set up yet are skipped; distinct ranges may be rewound
+    // concurrently.
+    void rewindPages(size_t begin, size_t end, int rounds);
+
+    // position of properties in the store's table, added if new (construction only)
+    uint32_t propertiesIndex(ChannelProperties* properties);
+
+    // Sets up edge e. Distinct edges may be connected concurrently.
+    void connect(EdgeId e, uint32_t targetIndex, interfaceId targetId, interfaceId targetInternalId,
+                 interfaceId sourceId, interfaceId sourceInternalId,
+                 uint32_t properties, int throughput);
+
+    // the arrival index of peer index's interface, nullptr to detach it
+    void setArrivals(uint32_t index, ArrivalWheel* arrivals) { _wheels[index] = arrivals; }
+
+    // outbound edges of peer source
+    std::pair<EdgeId, EdgeId> outbound(uint32_t source) const {
+        return {static_cast<EdgeId>(_firstOut[source]), static_cast<EdgeId>(_firstOut[source + 1])};
+    }
+    // the outbound edges of peer source that lead to targetId
+    std::pair<EdgeId, EdgeId> findOutbound(uint32_t source, interfaceId targetId) const;
 
-    interfaceId _targetId{ NO_PEER_ID };
-    interfaceId _targetInternalId{ NO_PEER_ID };
+    interfaceId targetId(EdgeId e) const {return page(e).targetId[slot(e)];}
+    interfaceId targetInternalId(EdgeId e) const {return page(e).targetInternalId[slot(e)];}
+    interfaceId sourceId(EdgeId e) const {return page(e).sourceId[slot(e)];}
+    interfaceId sourceInternalId(EdgeId e) const {return page(e).sourceInternalId[slot(e)];}
 
-    interfaceId _sourceId{ NO_PEER_ID };
-    interfaceId _sourceInternalId{ NO_PEER_ID };
+    // a removed outbound channel takes no more packets, those in flight still arrive
+    void close(EdgeId e) {page(e).open[slot(e)] = 0;}
+    bool isOpen(EdgeId e) const {return page(e).open[slot(e)] != 0;}
 
-    ChannelProperties* _properties; // properties of this channel
-    int    _throughputLeft{INT_MAX};   // throughputLeft, if you want a limited number of sends to reduce the maximum size of the channel
+    // Called by the source to push a new packet into the queue
+    void pushPacket(EdgeId e, Packet pkt);
 
-    // These are the packets that have been "sent" by the source side
-    // but not yet delivered to the target side.
-    deque<Packet> _packetQueue;
+    // Called by the target before removing packets from the queue. Only the
+    // packets sent before this round are reordered.
+    void shuffleChannel(EdgeId e);
 
-    // Helpers
-    bool canSend() const { return (_throughputLeft != 0 && (_properties->getSize() > _packetQueue.size())); }
-    int computeRandomDelay() const;
-    void consumeThroughput() {
-        if (_throughputLeft > 0) {
-            _throughputLeft--;
+    // Called by the target to remove packets from the queue
+    Packet popPacket(EdgeId e);
+
+    // Called by the target: reorder if needed, hand up to maxMsgsRec() packets
+    // that have arrived to sink and register whatever is left for a later
+    // round. Safe against a concurrent pushPacket.
+    template<typename F>
+    int deliverArrived(EdgeId e, F&& sink) {
+        std::unique_lock<std::mutex> lock = lockTarget(e);
+        shuffleChannel(e);
+        int recCount = 0;
+        while (recCount < maxMsgsRec(e) && frontHasArrived(e)) {
+            sink(popPacket(e));
+            ++recCount;
         }
+        if (_fused) {
+            Page& p = page(e);
+            p.drainedRound[slot(e)] = static_cast<uint32_t>(RoundManager::currentRound());
+            p.drained[slot(e)] = static_cast<uint32_t>(recCount);
+        }
+        // a drained channel gives its ring back until the next push
+        page(e).queue[slot(e)].shrink_to_fit();
+        scheduleArrival(e);
+        return recCount;
     }
 
-public:
-    Channel() = default;
-
-    // Create a channel with references to inbound side and outbound side
-    Channel(interfaceId targetId, interfaceId targetInternalId,
-            interfaceId sourceId, interfaceId sourceInternalId,
-            const json &channelParams);
-    ~Channel();
+    // Helpers
+    bool empty(EdgeId e) const {return page(e).queue[slot(e)].empty();}
+
+    int maxMsgsRec(EdgeId e) const {return properties(e).getMaxMsgsRec();}
+
+    // Register the next round the target has to visit edge e (no later than
+    // any registration already pending)
+    void scheduleArrival(EdgeId e);
+
+    // True if an entry collected for round is the live registration; consumes it
+    bool takeArrival(EdgeId e, size_t round) {
+        Page& p = page(e);
+        size_t i = slot(e);
+        std::unique_lock<std::mutex> lock = lockTarget(e);
+        if (p.wakeRound[i] != round) return false;
+        p.wakeRound[i] = SIZE_MAX;
+        return true;
+    }
 
-    interfaceId targetId() {return _targetId;}
-    interfaceId targetInternalId() {return _targetInternalId;}
-    interfaceId sourceId() {return _sourceId;}
-    interfaceId sourceInternalId() {return _sourceInternalId;}
+    bool frontHasArrived(EdgeId e) const {
+        const RingBuffer<Packet>& queue = page(e).queue[slot(e)];
+        if (queue.empty()) return false;
+        return queue.front().hasArrived();
+    }
 
-    void setParameters(const nlohmann::json &params);
+    // Earliest round in which the target has something to do on edge e,
+    // SIZE_MAX when nothing is in flight. Only the front packet can be delivered,
+    // and a queue that may be reordered draws from the RNG every round so it
+    // can never be skipped.
+    size_t nextEventRound(EdgeId e) const {
+        const RingBuffer<Packet>& queue = page(e).queue[slot(e)];
+        if (queue.empty()) return SIZE_MAX;
+        if (queue.size() > 1 && properties(e).getReorderProbability() > 0.0) {
+            return RoundManager::currentRound() + 1;
+        }
+        return queue.front().arrivalRound();
+    }
 
-    // Called by the source to push a new packet into the queue
-    void pushPacket(Packet pkt);
+private:
+    static constexpr size_t PAGE_BITS = 6;
+    static constexpr size_t PAGE_SIZE = size_t(1) << PAGE_BITS;
+
+    struct Page {
+        // touched by every send or receive on the edge
+        interfaceId targetId[PAGE_SIZE];         // target's public id, ordered within each source
+        uint32_t targetIndex[PAGE_SIZE];         // target's peer index, selects its arrival index
+        uint32_t propertyIndex[PAGE_SIZE];       // into _properties
+        int throughputLeft[PAGE_SIZE];           // sends left, if you want a limited number of sends to reduce the maximum size of the channel
+        // the packets that have been "sent" by the source side but not yet
+        // delivered to the target side
+        RingBuffer<Packet> queue[PAGE_SIZE];
+        size_t wakeRound[PAGE_SIZE];             // round the edge is registered for in its arrival index
+        // fused rounds only: packets the target took in round drainedRound,
+        // which still count against the size until that round ends
+        uint32_t drainedRound[PAGE_SIZE];
+        uint32_t drained[PAGE_SIZE];
+        uint8_t open[PAGE_SIZE];
+
+        // only read when receiving or rewiring
+        interfaceId sourceId[PAGE_SIZE];
+        interfaceId targetInternalId[PAGE_SIZE];
+        interfaceId sourceInternalId[PAGE_SIZE];
+    };
 
-    // Called by the target before removing packets from the queue
-    void shuffleChannel();
+    static size_t slot(EdgeId e) { return e & (PAGE_SIZE - 1); }
+    // the page of e, set up first if the network is implicit
+    Page& page(EdgeId e) const {
+        Page* p = _pages[e >> PAGE_BITS].load(std::memory_order_acquire);
+        return p != nullptr ? *p : implicitPage(e >> PAGE_BITS);
+    }
+    Page& implicitPage(size_t index) const;
+    void allocatePages(size_t edgeCount);
+    void allocateLocks();
+
+    // the queue, throughput and arrival registration of e, held while
+    // rounds are fused and not at all otherwise
+    std::unique_lock<std::mutex> lockTarget(EdgeId e) const {
+        if (!_targetLocks) return std::unique_lock<std::mutex>();
+        return std::unique_lock<std::mutex>(_targetLocks[page(e).targetIndex[slot(e)]]);
+    }
 
-    // Called by the target to remove packets from the queue
-    Packet popPacket();
+    const ChannelProperties& properties(EdgeId e) const {return *_properties[page(e).propertyIndex[slot(e)]];}
+
+    // Whether the source may push another packet this round. When rounds are
+    // fused the target may or may not have received yet, so what it takes in
+    // the round is counted until the round ends, either way.
+    bool canSend(EdgeId e) const {
+        const Page& p = page(e);
+        size_t i = slot(e);
+        size_t queued = p.queue[i].size();
+        if (_fused && p.drainedRound[i] == static_cast<uint32_t>(RoundManager::currentRound())) {
+            queued += p.drained[i];
+        }
+        return (p.throughputLeft[i] != 0 && (properties(e).getSize() > queued));
+    }
+    int computeRandomDelay(EdgeId e) const;
+    void consumeThroughput(EdgeId e) {
+        int& left = page(e).throughputLeft[slot(e)];
+        if (left > 0) {
+            left--;
+        }
+    }
 
-    // Helpers
-    bool empty() const {return _packetQueue.empty();}
+    size_t _edgeCount{0};
+    size_t _pageCount{0};
+    std::unique_ptr<std::atomic<Page*>[]> _pages;
+    std::vector<size_t> _firstOut;               // outbound edges of each peer
+    std::vector<ArrivalWheel*> _wheels;          // arrival index of each peer
+    bool _fused{false};
+    std::unique_ptr<std::mutex[]> _targetLocks;  // one per peer, only while fused
 
-    int maxMsgsRec() const {return _properties->getMaxMsgsRec();}
+    // distinct properties of the edges, owned by ChannelPropertiesFactory
+    std::vector<ChannelProperties*> _properties;
 
-    bool frontHasArrived() const {
-        if (_packetQueue.empty()) return false;
-        return _packetQueue.front().hasArrived();
-    }
+    // implicit networks only: the topology, and the throughput of a new edge
+    const ImplicitTopology* _topology{nullptr};
+    int _throughput{INT_MAX};
 };
 } // end namespace quantas
 
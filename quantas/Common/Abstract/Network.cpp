@@ -8,87 +8,365 @@ Network::~Network() {
     clearExisting();
 }
 
-void Network::clearExisting() {
-    // delete all owned peers
-    for (auto *p : _peers) {
-        p->clearInterface();
-        delete p;
-    }
+void Network::clearExisting(BS::thread_pool* pool) {
+    deletePeers(pool);
+    std::vector<interfaceId>().swap(_adjacency);
+    std::vector<size_t>().swap(_firstNeighbor);
+    std::vector<uint32_t>().swap(_edgeDistribution);
+    _edgeDistributions = json();
+    _channels.clear();
+    _implicit.reset();
+    _built = json();
+}
+
+void Network::createPeers(const std::string& type, int count, BS::thread_pool* pool) {
+    _peers.assign(count, nullptr);
+    // constructors running on the pool see the caller's rounds and log, and
+    // peer i gets internal id i (every peer type makes one interface) and
+    // draws from its own stream, whichever thread makes it
+    RoundManager* rounds = RoundManager::instance();
+    LogWriter* log = LogWriter::instance();
+    inParallel(count, pool, [&](int begin, int end) {
+        RoundManager::Scope roundScope(rounds);
+        LogWriter::Scope logScope(log);
+        for (int i = begin; i < end; ++i) {
+            interfaceId counter = NO_PEER_ID + i;
+            NetworkInterfaceAbstract::CounterScope ids(&counter);
+            useStream(i, RP_SETUP);
+            _peers[i] = PeerRegistry::makePeer(type, i);
+        }
+    });
+    NetworkInterfaceAbstract::resetCounter(NO_PEER_ID + count);
+}
+
+void Network::deletePeers(BS::thread_pool* pool) {
+    RoundManager* rounds = RoundManager::instance();
+    LogWriter* log = LogWriter::instance();
+    inParallel(static_cast<int>(_peers.size()), pool, [&](int begin, int end) {
+        RoundManager::Scope roundScope(rounds);
+        LogWriter::Scope logScope(log);
+        for (int i = begin; i < end; ++i) {
+            _peers[i]->clearInterface();
+            delete _peers[i];
+        }
+    });
     _peers.clear();
 }
 
+bool Network::canReuse(const json& topology) const {
+    if (_peers.empty() || _built.is_null()) return false;
+    if (_built["topology"] != topology || _built["distribution"] != _distribution) return false;
+    // shuffled again for every test
+    if (topology.value("identifiers", "") == "random") return false;
+    // drawn from the test's seed unless the topology has its own
+    if (RandomTopology::supports(topology.value("type", "")) && !topology.contains("seed")) return false;
+    if (_peers.size() != static_cast<size_t>(topology.value("initialPeers", 0))) return false;
+    // a peer that changed its neighbors changed the topology
+    for (auto* peer : _peers) {
+        NetworkInterface* networkInterface = peer->getNetworkInterface();
+        if (networkInterface == nullptr || !networkInterface->usesNetworkNeighbors()) return false;
+    }
+    return true;
+}
+
+void Network::reuseNetwork(BS::thread_pool* pool) {
+    if (_implicit) {
+        // nothing is stored per edge, set the channels up afresh
+        for (auto* peer : _peers) {
+            peer->getNetworkInterface()->useImplicitNeighbors(_implicit.get());
+        }
+        createImplicitChannels();
+        return;
+    }
+    int rounds = static_cast<int>(RoundManager::lastRound() - RoundManager::currentRound());
+    inParallel(static_cast<int>(_channels.pageCount()), pool, [&](int begin, int end) {
+        _channels.rewindPages(begin, end, rounds);
+    });
+    inParallel(static_cast<int>(_peers.size()), pool, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            NetworkInterface* networkInterface = _peers[i]->getNetworkInterface();
+            networkInterface->useSharedNeighbors(_adjacency.data() + _firstNeighbor[i],
+                                                 _adjacency.data() + _firstNeighbor[i + 1]);
+            if (auto abstractInterface = dynamic_cast<NetworkInterfaceAbstract*>(networkInterface)) {
+                abstractInterface->attachChannels(&_channels, static_cast<uint32_t>(i));
+            }
+        }
+    });
+}
+
 // create peers based on "topology" JSON
 // at this stage all public and internal 
 // ids are the same and unique across peers
-void Network::initNetwork(json topology) {
-    // Clear existing
-    clearExisting();
+void Network::initNetwork(json topology, BS::thread_pool* pool) {
+    // the same topology as the last test, still untouched, is kept; only
+    // the peers and their protocol state are made again
+    bool reuse = canReuse(topology);
+    if (reuse) {
+        deletePeers(pool);
+    } else {
+        clearExisting(pool);
+    }
 
     NetworkInterfaceAbstract::resetCounter();
 
     int initialPeers = topology.value("initialPeers", 0);
     std::string peerType = topology.value("initialPeerType", "");
     // build peers
-    for (int i = 0; i < initialPeers; i++) {
-        auto *peer = PeerRegistry::makePeer(peerType, i);
-        _peers.push_back(peer);
+    createPeers(peerType, initialPeers, pool);
+    useStream(NETWORK_STREAM, RP_SETUP);
+    if (reuse) {
+        reuseNetwork(pool);
+        return;
     }
+    _built = {{"topology", topology}, {"distribution", _distribution}};
 
-    if (topology.value("identifiers", "") == "random") {
-        static std::mt19937 rng(std::random_device{}());
-        std::shuffle(_peers.begin(), _peers.end(), rng);
+    bool randomIdentifiers = topology.value("identifiers", "") == "random";
+    if (randomIdentifiers) {
+        std::shuffle(_peers.begin(), _peers.end(), threadLocalEngine());
     }
 
     // pick the topology
     std::string t = topology.value("type", "");
+    int h = topology.value("height", 1);
+    int w = topology.value("width", 1);
 
-    if (t == "complete") {
-        fullyConnect(initialPeers);
-    } else if (t == "star") {
-        star(initialPeers);
-    } else if (t == "grid") {
-        int h = topology.value("height", 1);
-        int w = topology.value("width", 1);
-        grid(h, w);
-    } else if (t == "torus") {
-        int h = topology.value("height", 1);
-        int w = topology.value("width", 1);
-        torus(h, w);
-    } else if (t == "chain") {
-        chain(initialPeers);
-    } else if (t == "ring") {
-        ring(initialPeers);
-    } else if (t == "unidirectionalRing") {
-        unidirectionalRing(initialPeers);
-    } else if (t == "userList") {
-        userList(topology);
-    } else {
-        std::cerr << "Error: missing or unknown topology 'type' in JSON.\n";
-    }
-
-    createInitialChannels();
-}
-
-void Network::createInitialChannels() {
-// For each peer in the network create their channels from their neighbors
-for (auto* peer : _peers) {
-    auto neighbors = peer->neighbors();
-    for (auto nbr : neighbors) {
-            auto channelPtr = std::make_shared<Channel>(
-                /* target IDs: */ 
-                _peers[nbr]->publicId(), 
-                _peers[nbr]->internalId(),
-                /* outbound (the remote) IDs: */
-                peer->publicId(),
-                peer->internalId(),
-                _distribution
-            );
-            if (auto networkInterface = dynamic_cast<NetworkInterfaceAbstract*>(_peers[nbr]->getNetworkInterface())) {
-                networkInterface->addInboundChannel(peer->publicId(), channelPtr);
+    // neighbors computed from the index instead of stored, channels set up
+    // when first used
+    if (topology.value("implicit", false)) {
+        bool fits = (t != "grid" && t != "torus") || (long(h) * w <= initialPeers);
+        if (ImplicitTopology::supports(t) && !randomIdentifiers && fits) {
+            _implicit.reset(new ImplicitTopology(t, initialPeers, h, w));
+            for (auto* peer : _peers) {
+                peer->getNetworkInterface()->useImplicitNeighbors(_implicit.get());
+            }
+            createImplicitChannels();
+            return;
+        }
+        std::cerr << "Warning: topology '" << t << "' can not be implicit here, building it explicitly.\n";
+    }
+
+    // topology files, random graphs and the common topologies are filled in
+    // directly, the rest one neighbor at a time
+    if (t == "file") {
+        fileNeighbors(topology, pool);
+    } else if (RandomTopology::supports(t)) {
+        randomNeighbors(topology, pool);
+    } else if (!arithmeticNeighbors(t, h, w, pool)) {
+        if (t == "complete") {
+            fullyConnect(initialPeers);
+        } else if (t == "star") {
+            star(initialPeers);
+        } else if (t == "grid") {
+            grid(h, w);
+        } else if (t == "torus") {
+            torus(h, w);
+        } else if (t == "chain") {
+            chain(initialPeers);
+        } else if (t == "ring") {
+            ring(initialPeers);
+        } else if (t == "unidirectionalRing") {
+            unidirectionalRing(initialPeers);
+        } else if (t == "userList") {
+            userList(topology);
+        } else {
+            std::cerr << "Error: missing or unknown topology 'type' in JSON.\n";
+        }
+
+        compactNeighbors();
+    }
+    createInitialChannels(pool);
+}
+
+bool Network::arithmeticNeighbors(const std::string& type, int height, int width, BS::thread_pool* pool) {
+    const int peerCount = static_cast<int>(_peers.size());
+    bool fits = (type != "grid" && type != "torus") || (long(height) * width <= peerCount);
+    if (!ImplicitTopology::supports(type) || !fits || peerCount == 0) return false;
+
+    // the same neighbors, in the same order, as the builders below add
+    ImplicitTopology shape(type, peerCount, height, width);
+    _firstNeighbor.assign(peerCount + 1, 0);
+    for (int i = 0; i < peerCount; ++i) {
+        _firstNeighbor[i + 1] = _firstNeighbor[i] + shape.degree(i);
+    }
+    _adjacency.resize(_firstNeighbor.back());
+    inParallel(peerCount, pool, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            interfaceId* first = _adjacency.data() + _firstNeighbor[i];
+            interfaceId* last = _adjacency.data() + _firstNeighbor[i + 1];
+            for (interfaceId* nbr = first; nbr != last; ++nbr) {
+                *nbr = _peers[shape.neighbor(i, nbr - first)]->internalId();
+            }
+            // only out of order when the identifiers were shuffled
+            if (!std::is_sorted(first, last)) std::sort(first, last);
+            _peers[i]->getNetworkInterface()->useSharedNeighbors(first, last);
+        }
+    });
+    return true;
+}
+
+void Network::fileNeighbors(const json& topology, BS::thread_pool* pool) {
+    std::string path = topology.value("file", "");
+    TopologyFile file(path);
+    const size_t peerCount = _peers.size();
+    if (file.peers() > peerCount) {
+        throw std::runtime_error("topology file " + path + " has " + std::to_string(file.peers())
+                                 + " peers, initialPeers is " + std::to_string(peerCount));
+    }
+    // peers past the end of the file have no neighbors
+    _firstNeighbor.assign(peerCount + 1, file.edges());
+    std::copy(file.firstOut(), file.firstOut() + file.peers() + 1, _firstNeighbor.begin());
+    _adjacency.resize(file.edges());
+    if (const uint32_t* properties = file.properties()) {
+        _edgeDistributions = topology.value("distributions", json::array());
+        for (uint64_t k = 0; k < file.edges(); ++k) {
+            if (properties[k] >= _edgeDistributions.size()) {
+                throw std::runtime_error("topology file " + path + ": edge " + std::to_string(k)
+                                         + " uses distribution " + std::to_string(properties[k])
+                                         + ", \"distributions\" has " + std::to_string(_edgeDistributions.size()));
             }
-            if (auto networkInterface = dynamic_cast<NetworkInterfaceAbstract*>(peer->getNetworkInterface())) {
-                networkInterface->addOutboundChannel(_peers[nbr]->publicId(), channelPtr);
+        }
+        _edgeDistribution.assign(properties, properties + file.edges());
+    }
+    inParallel(static_cast<int>(peerCount), pool, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            interfaceId* first = _adjacency.data() + _firstNeighbor[i];
+            interfaceId* last = _adjacency.data() + _firstNeighbor[i + 1];
+            std::copy(file.targets() + _firstNeighbor[i], file.targets() + _firstNeighbor[i + 1], first);
+            _peers[i]->getNetworkInterface()->useSharedNeighbors(first, last);
+        }
+    });
+}
+
+void Network::randomNeighbors(const json& topology, BS::thread_pool* pool) {
+    // a seed of its own keeps the graph the same from test to test
+    uint64_t seed = topology.contains("seed") ? splitMix64(topology["seed"].get<uint64_t>()) : _seed;
+    const int peerCount = static_cast<int>(_peers.size());
+    RandomTopology(seed, RP_TOPOLOGY).generate(topology, peerCount, _firstNeighbor, _adjacency,
+        [pool](int count, auto&& body) { inParallel(count, pool, body); });
+    // generated over peer indices
+    inParallel(peerCount, pool, [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            interfaceId* first = _adjacency.data() + _firstNeighbor[i];
+            interfaceId* last = _adjacency.data() + _firstNeighbor[i + 1];
+            for (interfaceId* nbr = first; nbr != last; ++nbr) *nbr = _peers[*nbr]->internalId();
+            if (!std::is_sorted(first, last)) std::sort(first, last);
+            _peers[i]->getNetworkInterface()->useSharedNeighbors(first, last);
+        }
+    });
+}
+
+void Network::compactNeighbors() {
+    size_t total = 0;
+    for (auto* peer : _peers) total += peer->neighbors().size();
+    std::vector<interfaceId> adjacency;
+    adjacency.reserve(total);
+    for (auto* peer : _peers) {
+        NeighborView nbrs = peer->neighbors();
+        adjacency.insert(adjacency.end(), nbrs.begin(), nbrs.end());
+    }
+    // the old adjacency may still be viewed until every interface moved over
+    std::vector<size_t> firstNeighbor(_peers.size() + 1, 0);
+    for (size_t i = 0; i < _peers.size(); ++i) {
+        firstNeighbor[i + 1] = firstNeighbor[i] + _peers[i]->neighbors().size();
+        _peers[i]->getNetworkInterface()->useSharedNeighbors(adjacency.data() + firstNeighbor[i],
+                                                             adjacency.data() + firstNeighbor[i + 1]);
+    }
+    _adjacency.swap(adjacency);
+    _firstNeighbor.swap(firstNeighbor);
+}
+
+void Network::createInitialChannels(BS::thread_pool* pool) {
+    createChannels(_channels, _peers, _distribution, pool,
+                   _edgeDistribution.empty() ? nullptr : _edgeDistribution.data(), _edgeDistributions);
+}
+
+void Network::createChannels(ChannelStore& store, const std::vector<Peer*>& peers,
+                             const json& distribution, BS::thread_pool* pool,
+                             const uint32_t* edgeDistribution, const json& distributions) {
+    // channel k goes to targets[k], numbered source by source
+    // and ordered by the target's public ID within a source, so a source finds
+    // the channel to a neighbor by binary search in its own range
+    const int peerCount = static_cast<int>(peers.size());
+    std::vector<NetworkInterfaceAbstract*> interfaces(peerCount);
+    std::vector<size_t> firstOut(peerCount + 1, 0);
+    for (int i = 0; i < peerCount; ++i) {
+        interfaces[i] = dynamic_cast<NetworkInterfaceAbstract*>(peers[i]->getNetworkInterface());
+        firstOut[i + 1] = firstOut[i] + peers[i]->neighbors().size();
+    }
+    std::vector<int> targets(firstOut.back());
+    // each channel's entry of distributions follows its target through the sort
+    std::vector<uint32_t> kinds(edgeDistribution != nullptr ? targets.size() : 0);
+    auto byPublicId = [&peers](int a, int b) { return peers[a]->publicId() < peers[b]->publicId(); };
+    inParallel(peerCount, pool, [&](int begin, int end) {
+        std::vector<std::pair<int, uint32_t>> row;
+        for (int i = begin; i < end; ++i) {
+            auto first = targets.begin() + firstOut[i];
+            auto last = targets.begin() + firstOut[i + 1];
+            NeighborView nbrs = peers[i]->neighbors();
+            std::copy(nbrs.begin(), nbrs.end(), first);
+            if (kinds.empty()) {
+                if (!std::is_sorted(first, last, byPublicId)) std::sort(first, last, byPublicId);
+                continue;
             }
+            auto kind = kinds.begin() + firstOut[i];
+            std::copy(edgeDistribution + firstOut[i], edgeDistribution + firstOut[i + 1], kind);
+            if (std::is_sorted(first, last, byPublicId)) continue;
+            row.clear();
+            for (auto it = first; it != last; ++it) row.emplace_back(*it, kind[it - first]);
+            std::sort(row.begin(), row.end(), [&](const auto& a, const auto& b) { return byPublicId(a.first, b.first); });
+            for (size_t j = 0; j < row.size(); ++j) {
+                first[j] = row[j].first;
+                kind[j] = row[j].second;
+            }
+        }
+    });
+    store.reset(firstOut);
+
+    // every initial channel has the same properties and throughput, unless
+    // each takes its own entry of distributions
+    int rounds = static_cast<int>(RoundManager::lastRound() - RoundManager::currentRound());
+    std::vector<uint32_t> properties;
+    std::vector<int> throughput;
+    auto addProperties = [&](const json& params) {
+        ChannelProperties* channelProperties = ChannelPropertiesFactory::instance().create(params);
+        properties.push_back(store.propertiesIndex(channelProperties));
+        throughput.push_back(channelProperties->getMaxMsgsRec() * rounds);
+    };
+    if (kinds.empty()) {
+        addProperties(distribution);
+    } else {
+        for (const auto& entry : distributions) {
+            json merged = distribution;
+            merged.update(entry);
+            addProperties(merged);
+        }
+    }
+
+    // a task only touches the edges and interfaces of the peers in its range
+    auto connect = [&](int begin, int end) {
+        for (int i = begin; i < end; ++i) {
+            for (size_t k = firstOut[i]; k < firstOut[i + 1]; ++k) {
+                Peer* target = peers[targets[k]];
+                uint32_t kind = kinds.empty() ? 0 : kinds[k];
+                store.connect(static_cast<EdgeId>(k), static_cast<uint32_t>(targets[k]),
+                              target->publicId(), target->internalId(),
+                              peers[i]->publicId(), peers[i]->internalId(),
+                              properties[kind], throughput[kind]);
+            }
+            if (interfaces[i] != nullptr) interfaces[i]->attachChannels(&store, static_cast<uint32_t>(i));
+        }
+    };
+
+    inParallel(peerCount, pool, connect);
+}
+
+void Network::createImplicitChannels() {
+    ChannelProperties* properties = ChannelPropertiesFactory::instance().create(_distribution);
+    int throughput = properties->getMaxMsgsRec() * (RoundManager::lastRound() - RoundManager::currentRound());
+    _channels.reset(_implicit.get(), properties, throughput);
+    for (size_t i = 0; i < _peers.size(); ++i) {
+        if (auto networkInterface = dynamic_cast<NetworkInterfaceAbstract*>(_peers[i]->getNetworkInterface())) {
+            networkInterface->attachChannels(&_channels, static_cast<uint32_t>(i));
         }
     }
 }
@@ -199,18 +477,46 @@ void Network::userList(json topology) {
 }
 
 void Network::receive(int begin, int end) {
-    end = end < (int)_peers.size() ? end : (int)_peers.size();
     // call receive on each peer in the range
-    for (int i = begin; i < end; ++i) {
+    forPeers(begin, end, [this](int i) {
+        useStream(i, RP_RECEIVE);
         _peers[i]->receive();
-    }
+    });
 }
 
 void Network::tryPerformComputation(int begin, int end) {
-    end = end < (int)_peers.size() ? end : (int)_peers.size();
     // call tryPerformComputation on each peer in the range
-    for (int i = begin; i < end; ++i) {
+    forPeers(begin, end, [this](int i) {
+        useStream(i, RP_COMPUTE);
         _peers[i]->tryPerformComputation();
+    });
+}
+
+void Network::receiveAndCompute(int begin, int end) {
+    forPeers(begin, end, [this](int i) {
+        useStream(i, RP_RECEIVE);
+        _peers[i]->receive();
+        useStream(i, RP_COMPUTE);
+        _peers[i]->tryPerformComputation();
+    });
+}
+
+size_t Network::deliveredPackets() const {
+    size_t delivered = 0;
+    for (auto *peer : _peers) delivered += peer->deliveredPackets();
+    return delivered;
+}
+
+size_t Network::nextEventRound() const {
+    size_t next = RoundManager::currentRound() + 1;
+    if (_peers.empty() || !_peers[0]->idleEndOfRound()) return next;
+
+    size_t earliest = SIZE_MAX;
+    for (auto *peer : _peers) {
+        earliest = std::min(earliest, peer->nextEventRound());
+        // nothing to skip once something is due next round
+        if (earliest <= next) return next;
     }
+    return earliest;
 }
 }
\ No newline at end of file
@@ -28,8 +28,18 @@ along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
 #include <memory>
 #include <deque>
 #include <climits>
+#include <cstdint>
 #include "../Peer.hpp"
+#include "../ImplicitTopology.hpp"
+#include "../TopologyFile.hpp"
+#include "../RandomTopology.hpp"
+#include "Channel.hpp"
 #include "../Json.hpp"
+#include "../BS_thread_pool.hpp"
+#include "../RandomUtil.hpp"
+#include "../RoundManager.hpp"
+#include "../LogWriter.hpp"
+#include "Profiler.hpp"
 
 namespace quantas {
 
@@ -39,20 +49,109 @@ class Network {
 private:
     std::vector<Peer*>  _peers;
 
+    // Neighbors of all peers back to back, peer by peer (compressed sparse
+    // rows); each interface views its own slice. Filled once the topology is
+    // built, later changes go to the interface's private copy.
+    std::vector<interfaceId> _adjacency;
+    std::vector<size_t> _firstNeighbor; // peer i's slice starts at _adjacency[_firstNeighbor[i]]
+    void compactNeighbors();
+    // fills the adjacency straight from the arithmetic form of the topology
+    // types that have one, false if type has none
+    bool arithmeticNeighbors(const std::string& type, int height, int width, BS::thread_pool* pool);
+    // fills the adjacency from a topology file (see TopologyFile)
+    void fileNeighbors(const json& topology, BS::thread_pool* pool);
+    // fills the adjacency with a generated random graph (see RandomTopology)
+    void randomNeighbors(const json& topology, BS::thread_pool* pool);
+
+    // for a topology file with per-edge properties: each entry of
+    // _adjacency's index in _edgeDistributions, merged over _distribution
+    std::vector<uint32_t> _edgeDistribution;
+    json _edgeDistributions;
+
+    // set when the topology is implicit: neighbors are computed from it and
+    // channels are set up on first use
+    std::unique_ptr<ImplicitTopology> _implicit;
+    void createImplicitChannels();
+
+    // every channel between the peers, indexed by edge id
+    ChannelStore _channels;
+
     json _distribution;
+
+    // Random draws are made from the stream of whoever is acting: each peer
+    // has its own (its index in _peers), and setup and end of round use the
+    // network's. Positioned before every call, so the draws of a run depend on
+    // the seed only, not on the threads. What is logged meanwhile is ordered
+    // by the same index (see LogWriter::Buffered).
+    enum RandomPhase : uint32_t { RP_SETUP, RP_PARAMETERS, RP_RECEIVE, RP_COMPUTE, RP_END_OF_ROUND, RP_TOPOLOGY };
+    static constexpr uint32_t NETWORK_STREAM = UINT32_MAX;
+    uint64_t _seed{0};
+    void useStream(uint32_t stream, RandomPhase phase) const {
+        threadLocalEngine().reseat(_seed, stream, static_cast<uint32_t>(RoundManager::currentRound()), phase);
+        LogWriter::setSource(stream);
+    }
+
+    // Topology and distribution the neighbors and channels were built from.
+    // The next test on the same ones keeps both (see initNetwork).
+    json _built;
+    bool canReuse(const json& topology) const;
+    void reuseNetwork(BS::thread_pool* pool);
+
     Network& operator=(const Network &rhs) = delete;
     Network(const Network &rhs) = delete;
 
-    void clearExisting();
+    void createPeers(const std::string& type, int count, BS::thread_pool* pool);
+    void deletePeers(BS::thread_pool* pool);
+    void clearExisting(BS::thread_pool* pool = nullptr);
+
+    // set while the simulation is profiled: the peer loops then time every
+    // peer and report each range they ran
+    Profiler* _profiler{nullptr};
+    template<typename F>
+    void forPeers(int begin, int end, F&& body) {
+        end = end < (int)_peers.size() ? end : (int)_peers.size();
+        if (_profiler == nullptr) {
+            for (int i = begin; i < end; ++i) body(i);
+            return;
+        }
+        double start = _profiler->now();
+        for (int i = begin; i < end; ++i) {
+            double peerStart = _profiler->now();
+            body(i);
+            _profiler->peer(_peers[i]->publicId(), _profiler->now() - peerStart);
+        }
+        _profiler->chunk(begin, end, start);
+    }
+
+    // body(begin, end) over the indices [0, count), split across pool's
+    // threads when there is a pool with more than one
+    template<typename F>
+    static void inParallel(int count, BS::thread_pool* pool, F&& body) {
+        if (pool == nullptr || pool->get_thread_count() <= 1 || count < 2) {
+            body(0, count);
+        } else {
+            pool->parallelize_loop(count, body).wait();
+        }
+    }
 
 public:
     Network();
     ~Network();
     
     void setDistribution (json distribution) {_distribution = distribution;}
+    // seed of every random stream of the next test
+    void setSeed (uint64_t seed) {_seed = seed;}
+    // records the simulation loop in profiler, or nothing when null
+    void setProfiler (Profiler* profiler) {_profiler = profiler;}
+    // whether receiveAndCompute runs the rounds rather than two passes
+    void setFusedRounds (bool fused) {_channels.setFused(fused);}
     // -------------- TOPOLOGY INIT --------------
     // This can create the peers, set up neighbors, etc.
-    void initNetwork(json topology);
+    // Peers and channels are built on pool's threads when one is given.
+    // Called again with the same topology and distribution, after a test in
+    // which no peer changed its neighbors, only the peers are made again: the
+    // neighbors and channels are kept and the channels emptied.
+    void initNetwork(json topology, BS::thread_pool* pool = nullptr);
 
     // -------------- Topology Helpers --------------
     // Each function sets up "neighbors" among subsets of _peers
@@ -64,10 +163,20 @@ public:
     void ring(int numberOfPeers);
     void unidirectionalRing(int numberOfPeers);
     void userList(json topology);
-    void createInitialChannels();
+    void createInitialChannels(BS::thread_pool* pool = nullptr);
+
+    // Fills store with a channel for every neighbor of every peer and
+    // attaches each interface to it. With edgeDistribution, the channel to
+    // the k-th neighbor (counting peer by peer, in neighbors() order) takes
+    // distributions[edgeDistribution[k]] merged over distribution.
+    static void createChannels(ChannelStore& store, const std::vector<Peer*>& peers,
+                               const json& distribution, BS::thread_pool* pool = nullptr,
+                               const uint32_t* edgeDistribution = nullptr,
+                               const json& distributions = json::array());
 
     // -------------- Specialized Initilization ------------
     void initParameters(json parameters) {
+        useStream(NETWORK_STREAM, RP_PARAMETERS);
         _peers[0]->initParameters(_peers, parameters);
     }
 
@@ -75,8 +184,22 @@ public:
     // call each peer's receive, tryPerformComputation.
     void receive(int begin, int end);    
     void tryPerformComputation(int begin, int end);
+    // both phases per peer in one pass: packets sent in a round arrive in a
+    // later round at the earliest, so a peer's receive never depends on the
+    // computation of another peer in the same round
+    void receiveAndCompute(int begin, int end);
+
+    void endOfRound() {
+        useStream(NETWORK_STREAM, RP_END_OF_ROUND);
+        _peers[0]->endOfRound(_peers);
+    }
+
+    // earliest round in which any peer or channel has work to do,
+    // lets the simulation jump over rounds where nothing would happen
+    size_t nextEventRound() const;
 
-    void endOfRound() {_peers[0]->endOfRound(_peers); }
+    // packets the peers have received since they were made
+    size_t deliveredPackets() const;
 
     // -------------- Access by index --------------
     // (Might be optional if you rarely do random access.)
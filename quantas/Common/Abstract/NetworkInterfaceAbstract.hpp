@@ -2,10 +2,10 @@
 #define NETWORK_INTERFACE_ABSTRACT_HPP
 
 #include <memory>
-#include <map>
 #include <set>
 #include <deque>
 #include <string>
+#include <vector>
 #include <algorithm>
 #include "Channel.hpp"
 #include "../Packet.hpp"
@@ -16,89 +16,174 @@ namespace quantas {
 class NetworkInterfaceAbstract : public NetworkInterface {
 private:
     static inline interfaceId s_internalCounter = NO_PEER_ID;
+    // counter of the simulation running on this thread, see CounterScope
+    static inline thread_local interfaceId* t_internalCounter = nullptr;
+    static interfaceId& internalCounter() {
+        return t_internalCounter != nullptr ? *t_internalCounter : s_internalCounter;
+    }
 
-    // Inbound channels
-    // key = source peer's public ID
-    std::multimap<interfaceId, std::shared_ptr<Channel>> _inBoundChannels;
-
-    // Outbound channels
-    // key = target peer's public ID
-    std::multimap<interfaceId, std::shared_ptr<Channel>> _outBoundChannels;
+    // Channels of the network this interface was connected in, and this
+    // interface's peer index there; the store knows the outbound edge range
+    // of every peer and which arrival index each inbound edge reports to
+    ChannelStore* _channels{nullptr};
+    uint32_t _channelIndex{0};
+
+    // Inbound channels indexed by the round they next have packets due, so
+    // receive() never walks channels with nothing to deliver
+    ArrivalWheel _arrivals;
+    std::vector<ArrivalWheel::Entry> _dueArrivals;
+    std::vector<EdgeId> _dueChannels;
+
+    inline void detachChannels() {
+        if (_channels != nullptr) _channels->setArrivals(_channelIndex, nullptr);
+        _arrivals.clear();
+        _channels = nullptr;
+    }
 public:
 
     inline NetworkInterfaceAbstract() {
-        _internalId = ++s_internalCounter;
+        _internalId = ++internalCounter();
     };
     inline NetworkInterfaceAbstract(interfaceId pubId) : NetworkInterface(pubId) {
-        _internalId = ++s_internalCounter;
+        _internalId = ++internalCounter();
     };
     inline NetworkInterfaceAbstract(interfaceId pubId, interfaceId internalId) : NetworkInterface(pubId, internalId) {};
-    inline ~NetworkInterfaceAbstract() {};
-
-    static inline void resetCounter() {s_internalCounter = NO_PEER_ID;}
+    inline ~NetworkInterfaceAbstract() { detachChannels(); };
+
+    // the next interface created gets internal id last + 1
+    static inline void resetCounter(interfaceId last = NO_PEER_ID) {internalCounter() = last;}
+
+    // makes counter the source of internal ids on the calling thread for the
+    // lifetime of the scope, so simulations running side by side number their
+    // interfaces independently
+    class CounterScope {
+    public:
+        explicit CounterScope(interfaceId* counter) : _previous(t_internalCounter) { t_internalCounter = counter; }
+        ~CounterScope() { t_internalCounter = _previous; }
+        CounterScope(const CounterScope&) = delete;
+        CounterScope& operator=(const CounterScope&) = delete;
+    private:
+        interfaceId* _previous;
+    };
 
     // setters
-    inline void addInboundChannel(interfaceId srcPubId, std::shared_ptr<Channel> ch) {_inBoundChannels.emplace(srcPubId, ch);}
-    inline void addOutboundChannel(interfaceId tPubId, std::shared_ptr<Channel> ch) {_outBoundChannels.emplace(tPubId, ch);}
+    // hands the interface its channels in store, where it is peer index.
+    // Whatever store held before has been reset.
+    inline void attachChannels(ChannelStore* store, uint32_t index) {
+        _arrivals.clear();
+        _channels = store;
+        _channelIndex = index;
+        _channels->setArrivals(index, &_arrivals);
+    }
     inline void removeOutboundChannelByPublic(interfaceId remotePubId) {
-        auto range = _outBoundChannels.equal_range(remotePubId);
-        _outBoundChannels.erase(range.first, range.second);
+        if (_channels == nullptr) return;
+        auto range = _channels->findOutbound(_channelIndex, remotePubId);
+        for (EdgeId e = range.first; e != range.second; ++e) {
+            _channels->close(e);
+        }
     }
     inline void removeOutboundChannelByInternal(interfaceId targetInternalId) {
-        auto range = _outBoundChannels.equal_range(targetInternalId);
-        for (auto channel = _outBoundChannels.begin(); channel != _outBoundChannels.end(); ++channel) {
-            if (channel->second->targetInternalId() == targetInternalId) {
-                _outBoundChannels.erase(channel);
+        if (_channels == nullptr) return;
+        auto range = _channels->outbound(_channelIndex);
+        for (EdgeId e = range.first; e != range.second; ++e) {
+            if (_channels->targetInternalId(e) == targetInternalId) {
+                _channels->close(e);
             }
         }
     }
 
     // Send messages to to others using this
     inline void unicastTo (json msg, const interfaceId& dest) override;
+    inline void unicastSharedTo (const SharedMessage& msg, const interfaceId& dest) override;
+    inline void unicastPayloadTo (const Payload& msg, const interfaceId& dest) override;
     
     // moves msgs from the channel to the inStream if they've arrived
     inline void receive() override;
 
+    // earliest arrival across the inbound channels (only called between rounds)
+    inline size_t nextEventRound() const override;
+
     inline void clearAll() override {
+        detachChannels();
         _inStream.clear();
-        _inBoundChannels.clear();  
-        _outBoundChannels.clear();
-        _neighbors.clear();
+        clearNeighbors();
     }
 };
 
 void NetworkInterfaceAbstract::unicastTo(json msg, const interfaceId& nbr) {
-    if (_neighbors.find(nbr) == _neighbors.end()) return;
-    // find the channels with that key if they are our neighbor
-    auto range = _outBoundChannels.equal_range(nbr);
-    for (auto it = range.first; it != range.second; ++it) {
+    if (!isNeighbor(nbr)) return;
+    unicastSharedTo(makeSharedMessage(std::move(msg)), nbr);
+}
+
+void NetworkInterfaceAbstract::unicastSharedTo(const SharedMessage& msg, const interfaceId& nbr) {
+    if (!isNeighbor(nbr) || _channels == nullptr) return;
+    // find the channels to that neighbor
+    auto range = _channels->findOutbound(_channelIndex, nbr);
+    for (EdgeId e = range.first; e != range.second; ++e) {
+        if (!_channels->isOpen(e)) continue;
         Packet p;
         p.setSource(publicId());
         p.setTarget(nbr);
-        p.setMessage(msg);
-        it->second->pushPacket(p);
-        // std::cout << "Msg: " << msg << " to " << nbr << std::endl;
+        p.setSharedMessage(msg);
+        _channels->pushPacket(e, std::move(p));
+    }
+}
+
+void NetworkInterfaceAbstract::unicastPayloadTo(const Payload& msg, const interfaceId& nbr) {
+    if (!isNeighbor(nbr) || _channels == nullptr) return;
+    auto range = _channels->findOutbound(_channelIndex, nbr);
+    for (EdgeId e = range.first; e != range.second; ++e) {
+        if (!_channels->isOpen(e)) continue;
+        Packet p;
+        p.setSource(publicId());
+        p.setTarget(nbr);
+        p.setPayload(msg);
+        _channels->pushPacket(e, std::move(p));
     }
 }
 
 inline void NetworkInterfaceAbstract::receive() {
-    for (auto it = _inBoundChannels.begin(); it != _inBoundChannels.end(); ++it) {
-        auto &chPtr = it->second;
-
-        // reorder if needed
-        chPtr->shuffleChannel();
-
-        // pop up to chPtr->maxMsgsRec() messages that have arrived
-        int recCount = 0;
-        while (!chPtr->empty() 
-               && chPtr->frontHasArrived() 
-               && recCount < chPtr->maxMsgsRec()) 
-        {
-            Packet arrivedPkt = chPtr->popPacket();
-            _inStream.push_back(std::move(arrivedPkt));
-            ++recCount;
+    _dueArrivals.clear();
+    _arrivals.collect(RoundManager::currentRound(), _dueArrivals);
+    if (_dueArrivals.empty()) {
+        // idle this round: give back what the last burst of traffic left
+        // allocated (busy interfaces keep theirs from round to round)
+        if (_inStream.empty()) {
+            _inStream.release();
+            _arrivals.release();
+            std::vector<ArrivalWheel::Entry>().swap(_dueArrivals);
+            std::vector<EdgeId>().swap(_dueChannels);
+        }
+        return;
+    }
+
+    // drop entries superseded by an earlier registration
+    _dueChannels.clear();
+    for (auto &entry : _dueArrivals) {
+        if (_channels->takeArrival(entry.second, entry.first)) {
+            _dueChannels.push_back(entry.second);
         }
     }
+    // visit in order of the source's public ID
+    const ChannelStore& channels = *_channels;
+    std::sort(_dueChannels.begin(), _dueChannels.end(), [&channels](EdgeId a, EdgeId b) {
+        if (channels.sourceId(a) != channels.sourceId(b)) return channels.sourceId(a) < channels.sourceId(b);
+        return a < b;
+    });
+
+    for (EdgeId e : _dueChannels) {
+        _delivered += _channels->deliverArrived(e, [this](Packet&& arrivedPkt) {
+            _inStream.push_back(std::move(arrivedPkt));
+        });
+    }
+}
+
+inline size_t NetworkInterfaceAbstract::nextEventRound() const {
+    // packets still sitting in the inStream are waiting on the peer
+    if (!_inStream.empty()) return RoundManager::currentRound() + 1;
+
+    // may be early if a stale registration is pending, never late
+    return _arrivals.nextRound();
 }
 
 }
@@ -0,0 +1,123 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Splits the peers of a round phase across the thread pool.
+//
+// "static" hands each thread one contiguous block of equal size (the pool's
+// parallelize_loop). "dynamic" cuts the peers into small chunks that idle
+// threads keep claiming from a shared counter until none are left, so a thread
+// that got a heavy peer (a leader, the center of a star) simply claims fewer
+// chunks instead of holding up the whole round.
+//
+// Either way only the first threads() of the pool's threads take part; with
+// one, the phase runs on the calling thread without going through the pool.
+//
+// "executor": "team" runs the phases on a WorkerTeam of as many threads as
+// the pool instead, the calling thread among them. Member m of the first
+// threads() then always gets the m-th block, or claims chunks just the same.
+// The pool is left to the work outside the rounds.
+
+#ifndef PEER_SCHEDULER_HPP
+#define PEER_SCHEDULER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <stdexcept>
+#include <string>
+
+#include "../BS_thread_pool.hpp"
+#include "../Json.hpp"
+#include "WorkerTeam.hpp"
+
+namespace quantas {
+
+using nlohmann::json;
+
+class PeerScheduler {
+public:
+    enum class Mode { STATIC, DYNAMIC };
+
+    PeerScheduler(BS::thread_pool& pool, const json& config) : _pool(pool) {
+        std::string mode = config.value("scheduling", "static");
+        if (mode == "static") _mode = Mode::STATIC;
+        else if (mode == "dynamic") _mode = Mode::DYNAMIC;
+        else throw std::invalid_argument("unknown scheduling \"" + mode + "\"");
+        _chunkSize = config.value("chunkSize", 0);
+        _threads = static_cast<int>(_pool.get_thread_count());
+        std::string executor = config.value("executor", "pool");
+        if (executor == "team") {
+            if (_threads > 1) _team = std::make_unique<WorkerTeam>(_threads);
+        } else if (executor != "pool") {
+            throw std::invalid_argument("unknown executor \"" + executor + "\"");
+        }
+    }
+
+    // threads the next phases run on, at most the pool's
+    int threads() const { return _threads; }
+    void setThreads(int threads) {
+        _threads = std::max(1, std::min(threads, static_cast<int>(_pool.get_thread_count())));
+    }
+
+    // calls loop(begin, end) over [0, size) and returns once every peer is done
+    template<typename F>
+    void run(int size, F&& loop) {
+        if (size <= 0) return;
+        int threads = _threads;
+        if (threads == 1) {
+            loop(0, size);
+            return;
+        }
+        if (_mode == Mode::STATIC) {
+            if (_team) {
+                _team->run([&loop, size, threads](int member) {
+                    if (member >= threads) return;
+                    int begin = int(int64_t(size) * member / threads);
+                    int end = int(int64_t(size) * (member + 1) / threads);
+                    if (begin < end) loop(begin, end);
+                });
+                return;
+            }
+            _pool.parallelize_loop(0, size, loop, threads).wait();
+            return;
+        }
+
+        // a few chunks per thread keeps the claims cheap and the tail short
+        int chunk = _chunkSize > 0 ? _chunkSize : std::max(1, size / (8 * threads));
+        int workers = std::min(threads, (size + chunk - 1) / chunk);
+        std::atomic<int> next{0};
+        auto claim = [&next, &loop, chunk, size]() {
+            for (int begin = next.fetch_add(chunk, std::memory_order_relaxed); begin < size;
+                 begin = next.fetch_add(chunk, std::memory_order_relaxed)) {
+                loop(begin, std::min(begin + chunk, size));
+            }
+        };
+        if (_team) {
+            _team->run([&claim, workers](int member) {
+                if (member < workers) claim();
+            });
+            return;
+        }
+        BS::multi_future<void> mf(workers);
+        for (int w = 0; w < workers; ++w) mf[w] = _pool.submit(claim);
+        mf.wait();
+    }
+
+private:
+    BS::thread_pool& _pool;
+    Mode _mode{Mode::STATIC};
+    int _chunkSize{0};   // peers per claimed chunk, 0 picks one from the network size
+    int _threads{1};     // threads taking part in a phase
+    std::unique_ptr<WorkerTeam> _team;   // runs the phases instead of the pool
+};
+
+} // namespace quantas
+
+#endif /* PEER_SCHEDULER_HPP */
@@ -0,0 +1,239 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Opt-in profiler ("profile" in an experiment). Writes a Chrome trace-event
+// file (open it in https://ui.perfetto.dev or chrome://tracing) as the run
+// goes:
+//
+//   - on the simulation thread of each group of tests: every test, network
+//     setup, round and phase (receive, compute, endOfRound), each phase with
+//     every worker's busy and idle time until the barrier
+//   - on each worker thread: the peers it ran in every phase
+//   - with every round: the slowest peers of the round and their phase
+//
+// The experiment's log gets the total time of each kind of span. Nothing is
+// measured unless the simulation has a Profiler; callers hold a null pointer
+// otherwise and test it once per phase or per chunk of peers.
+
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "../Json.hpp"
+
+namespace quantas {
+
+using nlohmann::json;
+
+// The trace file of an experiment, shared by the profilers of its tests
+class TraceFile {
+public:
+    explicit TraceFile(const std::string& path) : _start(std::chrono::steady_clock::now()) {
+        _out.open(path);
+        if (!_out.is_open()) std::cerr << "[Profiler] Failed to open trace file: " << path << ".\n";
+        _out << "[";
+    }
+    ~TraceFile() {
+        _out << "\n]\n";
+    }
+    TraceFile(const TraceFile&) = delete;
+    TraceFile& operator=(const TraceFile&) = delete;
+
+    // microseconds since the file was opened
+    double now() const {
+        return std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - _start).count();
+    }
+
+    void write(const json& event) {
+        std::string text = event.dump();
+        std::lock_guard<std::mutex> lock(_mutex);
+        _out << (_events++ == 0 ? "\n" : ",\n") << text;
+    }
+
+    // a process id for a group of tests, a thread id for a thread
+    int newProcess() { return _processes++; }
+    int newThread() { return _threads++; }
+
+    void addTotal(const std::string& name, double us) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _totals[name] += us / 1e6;
+    }
+    // seconds spent in each kind of span
+    json totals() const {
+        std::lock_guard<std::mutex> lock(_mutex);
+        return json(_totals);
+    }
+
+private:
+    std::chrono::steady_clock::time_point _start;
+    std::ofstream _out;
+    size_t _events{0};
+    std::map<std::string, double> _totals;
+    std::atomic<int> _processes{0};
+    std::atomic<int> _threads{1};   // 0 is every simulation thread
+    mutable std::mutex _mutex;
+};
+
+// Records the tests run on one network and thread pool
+class Profiler {
+public:
+    Profiler(TraceFile& file, int slowestPeers)
+        : _file(file), _pid(file.newProcess()), _slowest(std::max(0, slowestPeers)), _id(++s_lastId) {
+        _file.write({{"name", "process_name"}, {"ph", "M"}, {"pid", _pid},
+                     {"args", {{"name", "tests " + std::to_string(_pid)}}}});
+        _file.write({{"name", "thread_name"}, {"ph", "M"}, {"pid", _pid}, {"tid", 0},
+                     {"args", {{"name", "simulation"}}}});
+    }
+    Profiler(const Profiler&) = delete;
+    Profiler& operator=(const Profiler&) = delete;
+
+    double now() const { return _file.now(); }
+
+    // a span on the simulation thread from start until now
+    void span(const std::string& name, double start, json args = json()) {
+        double end = now();
+        json event = {{"name", name}, {"ph", "X"}, {"pid", _pid}, {"tid", 0}, {"ts", start}, {"dur", end - start}};
+        if (!args.is_null()) event["args"] = std::move(args);
+        _file.write(event);
+        _file.addTotal(name, end - start);
+    }
+
+    // times a span on the simulation thread; does nothing without a profiler
+    class Scope {
+    public:
+        Scope(Profiler* profiler, const char* name)
+            : _profiler(profiler), _name(name), _start(profiler != nullptr ? profiler->now() : 0) {}
+        ~Scope() { if (_profiler != nullptr) _profiler->span(_name, _start, std::move(_args)); }
+        json& args() { return _args; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        Profiler* _profiler;
+        const char* _name;
+        double _start;
+        json _args;
+    };
+
+    // -------- phases, run by the simulation thread --------
+    void beginPhase(const char* name) {
+        _phase = name;
+        _phaseStart = now();
+    }
+
+    // The phase's span with every worker's busy and idle time, the workers'
+    // spans, and its slowest peers as candidates for the round's
+    void endPhase() {
+        double end = now();
+        double length = end - _phaseStart;
+        json busy = json::object(), idle = json::object();
+        std::lock_guard<std::mutex> lock(_mutex);
+        for (auto& worker : _workers) {
+            double time = 0;
+            for (const Chunk& chunk : worker->chunks) {
+                time += chunk.end - chunk.start;
+                _file.write({{"name", _phase}, {"ph", "X"}, {"pid", _pid}, {"tid", worker->tid},
+                             {"ts", chunk.start}, {"dur", chunk.end - chunk.start},
+                             {"args", {{"peers", std::to_string(chunk.first) + "-" + std::to_string(chunk.last - 1)}}}});
+            }
+            worker->chunks.clear();
+            if (time == 0) continue;
+            std::string name = "worker " + std::to_string(worker->tid);
+            busy[name] = time;
+            idle[name] = std::max(0.0, length - time);
+            for (const PeerTime& peer : worker->slowest) _roundSlowest.push_back(PeerTime{peer.us, peer.id, _phase});
+            worker->slowest.clear();
+        }
+        _file.write({{"name", _phase}, {"ph", "X"}, {"pid", _pid}, {"tid", 0}, {"ts", _phaseStart},
+                     {"dur", length}, {"args", {{"busy_us", busy}, {"idle_us", idle}}}});
+        _file.addTotal(_phase, length);
+    }
+
+    // the slowest peers of the round so far, for the round's span
+    json takeSlowestPeers() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        std::sort(_roundSlowest.begin(), _roundSlowest.end(),
+                  [](const PeerTime& a, const PeerTime& b) { return a.us > b.us; });
+        json peers = json::array();
+        for (size_t k = 0; k < std::min(_roundSlowest.size(), _slowest); ++k) {
+            peers.push_back({{"peer", _roundSlowest[k].id}, {"phase", _roundSlowest[k].phase}, {"us", _roundSlowest[k].us}});
+        }
+        _roundSlowest.clear();
+        return peers;
+    }
+
+    // -------- recorded by the workers during a phase --------
+    // peers [first, last) ran from start until now on the calling thread
+    void chunk(int first, int last, double start) {
+        worker().chunks.push_back(Chunk{start, now(), first, last});
+    }
+
+    // the peer with public id id took us microseconds
+    void peer(long id, double us) {
+        if (_slowest == 0) return;
+        std::vector<PeerTime>& slowest = worker().slowest;
+        auto faster = [](const PeerTime& a, const PeerTime& b) { return a.us > b.us; };
+        if (slowest.size() < _slowest) {
+            slowest.push_back(PeerTime{us, id, nullptr});
+            std::push_heap(slowest.begin(), slowest.end(), faster);
+        } else if (us > slowest.front().us) {
+            std::pop_heap(slowest.begin(), slowest.end(), faster);
+            slowest.back() = PeerTime{us, id, nullptr};
+            std::push_heap(slowest.begin(), slowest.end(), faster);
+        }
+    }
+
+private:
+    struct Chunk { double start, end; int first, last; };
+    struct PeerTime { double us; long id; const char* phase; };
+    struct Worker {
+        int tid;
+        std::vector<Chunk> chunks;
+        std::vector<PeerTime> slowest;   // min-heap on the time
+    };
+
+    static inline std::atomic<uint64_t> s_lastId{0};
+
+    // the calling thread's records, made on its first
+    Worker& worker() {
+        struct Cached { uint64_t owner; Worker* worker; };
+        static thread_local Cached cached{0, nullptr};
+        if (cached.owner == _id) return *cached.worker;
+        std::lock_guard<std::mutex> lock(_mutex);
+        _workers.emplace_back(new Worker{_file.newThread(), {}, {}});
+        Worker* w = _workers.back().get();
+        _file.write({{"name", "thread_name"}, {"ph", "M"}, {"pid", _pid}, {"tid", w->tid},
+                     {"args", {{"name", "worker " + std::to_string(w->tid)}}}});
+        cached = Cached{_id, w};
+        return *w;
+    }
+
+    TraceFile& _file;
+    const int _pid;
+    const size_t _slowest;
+    const uint64_t _id;
+    const char* _phase{""};
+    double _phaseStart{0};
+    std::vector<std::unique_ptr<Worker>> _workers;
+    std::vector<PeerTime> _roundSlowest;
+    std::mutex _mutex;
+};
+
+} // namespace quantas
+
+#endif /* PROFILER_HPP */
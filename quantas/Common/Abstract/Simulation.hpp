@@ -15,12 +15,24 @@ You should have received a copy of the GNU General Public License along with QUA
 #ifndef Simulation_hpp
 #define Simulation_hpp
 
+#include <atomic>
 #include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <random>
 #include <thread>
 #include <fstream>
+#include <memory>
+#include <mutex>
+#include <vector>
 
 #include "Network.hpp"
+#include "NetworkInterfaceAbstract.hpp"
+#include "PeerScheduler.hpp"
+#include "Profiler.hpp"
+#include "ThreadTuner.hpp"
 #include "../LogWriter.hpp"
+#include "../RoundManager.hpp"
 #include "../BS_thread_pool.hpp"
 #include "../memoryUtil.hpp"
 
@@ -31,74 +43,241 @@ namespace quantas {
 
 	class Simulation {
 	private:
-		Network system;
+		// What a test reaches through the static RoundManager, LogWriter and
+		// interface id accessors. Tests running side by side each have their
+		// own, and every thread working on a test binds it while it does.
+		struct Context {
+			RoundManager rounds;
+			LogWriter log;
+			interfaceId internalCounter{NO_PEER_ID};
+		};
+
+		class ContextScope {
+		public:
+			explicit ContextScope(Context& context)
+				: _rounds(&context.rounds), _log(&context.log), _ids(&context.internalCounter) {}
+		private:
+			RoundManager::Scope _rounds;
+			LogWriter::Scope _log;
+			NetworkInterfaceAbstract::CounterScope _ids;
+		};
+
+		Context _context; // holds the experiment's log
 
 		static size_t _peakMemoryKB;
+		static std::mutex _peakMemoryMutex;
+		static int _running; // simulations currently in run()
+		static std::mutex _runningMutex;
+
+		// runs tests claimed from nextTest until all have been run, recorded
+		// in trace when it is not null; resetBlocks when no other test of
+		// this simulation runs at the same time
+		inline void runTests(const json& config, Context& context, std::atomic<int>& nextTest, bool resetBlocks,
+		                     TraceFile* trace);
+		// gives the block pool's memory back unless another simulation is
+		// running; one that starts meanwhile waits for the reset to finish
+		static inline void resetBlockPool();
 	public:
 		inline void run(json config);
 	};
 
 	size_t Simulation::_peakMemoryKB = 0;
+	std::mutex Simulation::_peakMemoryMutex;
+	int Simulation::_running = 0;
+	std::mutex Simulation::_runningMutex;
+
+	inline void Simulation::resetBlockPool() {
+		std::lock_guard<std::mutex> lock(_runningMutex);
+		if (_running == 1) BlockPool::reset();
+	}
 
 	inline void Simulation::run(json config) {
+		ContextScope scope(_context);
+		{
+			std::lock_guard<std::mutex> lock(_runningMutex);
+			++_running;
+		}
+
 		std::string logFile = config.value("logFile", "cout");
-		LogWriter::setLogFile(logFile); // Set the log file to the console
+		LogWriter::setLogFile(logFile, config.value("logFormat", "json"));
 
 		std::chrono::time_point<std::chrono::high_resolution_clock> startTime, endTime; // chrono time points
    		std::chrono::duration<double> duration; // chrono time interval
 		startTime = std::chrono::high_resolution_clock::now();
 
-		int _threadCount = config.value("threadCount", thread::hardware_concurrency()); // By default, use as many hardware cores as possible
+		// every random draw of the experiment derives from this seed
+		if (!config.contains("seed")) {
+			config["seed"] = (uint64_t(std::random_device{}()) << 32) ^ uint64_t(std::time(nullptr));
+		}
+		LogWriter::setValue("seed", config["seed"].get<uint64_t>());
+
+		// Chrome trace of the run's tests, rounds and phases (see Profiler)
+		std::unique_ptr<TraceFile> trace;
+		if (config.contains("profile")) trace = std::make_unique<TraceFile>(config["profile"].get<std::string>());
+
+		// number of tests run at the same time, each on its own network
+		int parallelTests = std::min(config.value("parallelTests", 1), static_cast<int>(config["tests"]));
+		std::atomic<int> nextTest{0};
+		if (parallelTests <= 1) {
+			runTests(config, _context, nextTest, true, trace.get());
+		} else {
+			std::vector<std::unique_ptr<Context>> contexts;
+			std::vector<thread> workers;
+			for (int w = 0; w < parallelTests; ++w) {
+				contexts.push_back(std::make_unique<Context>());
+				contexts.back()->log.streamThrough(&_context.log);
+				workers.emplace_back([this, &config, &nextTest, &trace, context = contexts.back().get()]() {
+					ContextScope workerScope(*context);
+					runTests(config, *context, nextTest, false, trace.get());
+				});
+			}
+			for (auto& worker : workers) worker.join();
+			for (auto& context : contexts) LogWriter::merge(context->log);
+		}
+		
+		endTime = std::chrono::high_resolution_clock::now();
+   		duration = endTime - startTime;
+		LogWriter::setValue("RunTime", double(duration.count()));
+		if (trace) {
+			// seconds spent in each kind of span, over all tests
+			LogWriter::setValue("Profile", trace->totals());
+			trace.reset();
+		}
+
+		size_t peakMemoryKB = getPeakMemoryKB();
+		std::unique_lock<std::mutex> peakLock(_peakMemoryMutex);
+		if (_peakMemoryKB < peakMemoryKB) {
+			_peakMemoryKB = peakMemoryKB;
+			peakLock.unlock();
+			LogWriter::setValue("Peak Memory KB", peakMemoryKB);
+		} else {
+			peakLock.unlock();
+			LogWriter::setValue("Previous Peak Memory KB", peakMemoryKB);
+		}
+
+		LogWriter::print();
+		std::lock_guard<std::mutex> lock(_runningMutex);
+		--_running;
+	}
+
+	inline void Simulation::runTests(const json& config, Context& context, std::atomic<int>& nextTest, bool resetBlocks,
+	                                 TraceFile* trace) {
+		// "auto": the phases use as many of the cores as run rounds fastest (see ThreadTuner)
+		bool autoThreads = config.contains("threadCount") && config["threadCount"] == "auto";
+		int _threadCount = autoThreads ? thread::hardware_concurrency()
+		                               : config.value("threadCount", thread::hardware_concurrency()); // By default, use as many hardware cores as possible
 		if (_threadCount <= 0) { _threadCount = 1;}
 		if (_threadCount > config["topology"]["initialPeers"]) {
 			_threadCount = config["topology"]["initialPeers"];
 		}
 		int networkSize = static_cast<int>(config["topology"]["initialPeers"]);
-		
+		// jump over rounds in which no packet arrives and no peer has work
+		bool skipIdleRounds = config.value("skipIdleRounds", false);
+		// run each peer's receive and computation in one parallel pass per round
+		bool fusedRounds = config.value("fusedRounds", false);
+		// log the wall time of every round
+		bool roundTiming = config.value("roundTiming", false);
+		// log the packets delivered in every test
+		bool countPackets = config.value("countPackets", false);
+
+		Network system;
 		BS::thread_pool pool(_threadCount);
-		for (int i = 0; i < config["tests"]; i++) {
+		PeerScheduler scheduler(pool, config);
+		std::unique_ptr<ThreadTuner> tuner;
+		if (autoThreads) tuner = std::make_unique<ThreadTuner>(_threadCount);
+		// the thread count the phases use from the next round on
+		auto logThreads = [&]() {
+			LogWriter::pushValue("threadCount", json{{"round", RoundManager::currentRound() + 1}, {"threads", tuner->threads()}});
+		};
+		// null unless profiled, every measurement below checks it first
+		std::unique_ptr<Profiler> profiler;
+		if (trace != nullptr) profiler = std::make_unique<Profiler>(*trace, config.value("profilePeers", 5));
+		Profiler* prof = profiler.get();
+		system.setProfiler(prof);
+		system.setFusedRounds(fusedRounds);
+		// one phase of the round on the scheduler, a span of it when profiled
+		auto runPhase = [&](const char* name, auto phase) {
+			// values the peers log during a phase are merged when it ends
+			LogWriter::Buffered buffered;
+			if (prof != nullptr) prof->beginPhase(name);
+			scheduler.run(networkSize, phase);
+			if (prof != nullptr) prof->endPhase();
+		};
+		// worker threads see this test's context while running a phase
+		auto inContext = [&context](auto phase) {
+			return [&context, phase](int a, int b) {
+				ContextScope scope(context);
+				phase(a, b);
+			};
+		};
+
+		for (int i = nextTest++; i < config["tests"]; i = nextTest++) {
+			Profiler::Scope testSpan(prof, "test");
+			if (prof != nullptr) testSpan.args()["test"] = i;
 			LogWriter::instance()->setTest(i);
 			RoundManager::instance()->setCurrentRound(0);
 			RoundManager::instance()->setLastRound(config["rounds"]);
+			system.setSeed(splitMix64(config["seed"].get<uint64_t>() + i));
 			// Configure the delay properties and initial topology of the network
 			system.setDistribution(config["distribution"]);
-			system.initNetwork(config["topology"]);
-			if (config.contains("parameters")) {
-				system.initParameters(config["parameters"]);
-			} else {
-				json empty;
-				system.initParameters(empty);
+			{
+				Profiler::Scope span(prof, "initNetwork");
+				system.initNetwork(config["topology"], &pool);
+			}
+			// the previous test's packets are gone, give their memory back
+			if (resetBlocks) resetBlockPool();
+			{
+				Profiler::Scope span(prof, "initParameters");
+				if (config.contains("parameters")) {
+					system.initParameters(config["parameters"]);
+				} else {
+					json empty;
+					system.initParameters(empty);
+				}
 			}
 			
+			if (tuner && !tuner->trying()) logThreads();
 			//std::cout << "Test " << i + 1 << std::endl;
-			for (int j = 0; j < config["rounds"]; j++) {
-				// std::cout << "ROUND " << j + 1 << std::endl;
+			while (RoundManager::currentRound() < RoundManager::lastRound()) {
+				if (skipIdleRounds) {
+					// the last round always runs so end of test metrics are still logged
+					size_t next = std::min(system.nextEventRound(), RoundManager::lastRound());
+					if (next > RoundManager::currentRound() + 1) {
+						RoundManager::setCurrentRound(next - 1);
+					}
+				}
+				// std::cout << "ROUND " << RoundManager::currentRound() + 1 << std::endl;
 				RoundManager::incrementRound();
+				Profiler::Scope roundSpan(prof, "round");
+				std::chrono::steady_clock::time_point roundStart;
+				if (tuner) scheduler.setThreads(tuner->threads());
+				if (roundTiming || tuner) roundStart = std::chrono::steady_clock::now();
 
-				// do the receive phase of the round
-				BS::multi_future<void> receive_loop = pool.parallelize_loop(networkSize, [this](int a, int b){system.receive(a, b);});
-				receive_loop.wait();
+				if (fusedRounds) {
+					runPhase("receiveAndCompute", inContext([&system](int a, int b){system.receiveAndCompute(a, b);}));
+				} else {
+					// do the receive phase of the round
+					runPhase("receive", inContext([&system](int a, int b){system.receive(a, b);}));
+					// then the computation phase
+					runPhase("compute", inContext([&system](int a, int b){system.tryPerformComputation(a, b);}));
+				}
 
-				BS::multi_future<void> compute_loop = pool.parallelize_loop(networkSize, [this](int a, int b){system.tryPerformComputation(a, b);});
-				compute_loop.wait();
+				{
+					Profiler::Scope span(prof, "endOfRound");
+					system.endOfRound(); // do any end of round computations
+				}
+				if (prof != nullptr) {
+					roundSpan.args() = {{"round", RoundManager::currentRound()}, {"slowestPeers", prof->takeSlowestPeers()}};
+				}
 
-				system.endOfRound(); // do any end of round computations
+				if (roundTiming || tuner) {
+					std::chrono::duration<double> roundTime = std::chrono::steady_clock::now() - roundStart;
+					if (roundTiming) LogWriter::pushValue("roundTime", roundTime.count());
+					if (tuner && tuner->roundDone(roundTime.count())) logThreads();
+				}
 			}
+			if (countPackets) LogWriter::pushValue("packetsDelivered", system.deliveredPackets());
 		}
-		
-		endTime = std::chrono::high_resolution_clock::now();
-   		duration = endTime - startTime;
-		LogWriter::setValue("RunTime", double(duration.count()));
-
-		size_t peakMemoryKB = getPeakMemoryKB();
-		if (_peakMemoryKB < peakMemoryKB) {
-			_peakMemoryKB = peakMemoryKB;
-			LogWriter::setValue("Peak Memory KB", peakMemoryKB);
-		} else {
-			LogWriter::setValue("Previous Peak Memory KB", peakMemoryKB);
-		}
-
-		LogWriter::print();
 	}
 
 	
@@ -0,0 +1,111 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Picks how many threads run the round phases when threadCount is "auto".
+//
+// It tries 1, 2, 4, ... up to the pool's threads, taking turns round by round
+// so that a load that drifts over the first rounds favors none of them. After
+// TRIALS rounds each, the count with the lowest median round time is kept.
+// When the round time then moves by more than a factor of CHANGE either way
+// (a block storm starts, the traffic dies down), the counts are tried again.
+// Trials that keep the same count double the rounds before the next one may
+// start, so a noisy round time does not keep the simulation trying. Results
+// do not depend on the count, only the time does.
+
+#ifndef THREAD_TUNER_HPP
+#define THREAD_TUNER_HPP
+
+#include <algorithm>
+#include <vector>
+
+namespace quantas {
+
+class ThreadTuner {
+public:
+    explicit ThreadTuner(int maxThreads) {
+        for (int t = 1; t < maxThreads; t *= 2) _candidates.push_back(t);
+        _candidates.push_back(std::max(1, maxThreads));
+        _samples.resize(_candidates.size());
+        if (_candidates.size() == 1) decide(0, 0);
+    }
+
+    // threads the next round runs on
+    int threads() const { return _trying ? _candidates[_next] : _threads; }
+    // whether the counts are being tried rather than one kept
+    bool trying() const { return _trying; }
+
+    // The round just run on threads() took seconds. True when that settled
+    // on a new thread count, which is then threads().
+    bool roundDone(double seconds) {
+        if (!_trying) {
+            _average += (seconds - _average) * SMOOTHING;
+            if (++_steadyRounds >= _settle
+                && (_average > _baseline * CHANGE || _average * CHANGE < _baseline)) {
+                startTrials();
+            }
+            return false;
+        }
+        _samples[_next].push_back(seconds);
+        if (++_next < _candidates.size()) return false;
+        _next = 0;
+        if (_samples[0].size() < TRIALS) return false;
+
+        size_t best = 0;
+        double bestTime = 0;
+        for (size_t c = 0; c < _candidates.size(); ++c) {
+            std::vector<double>& s = _samples[c];
+            std::nth_element(s.begin(), s.begin() + s.size() / 2, s.end());
+            if (c == 0 || s[s.size() / 2] < bestTime) {
+                best = c;
+                bestTime = s[s.size() / 2];
+            }
+        }
+        int previous = _decided ? _threads : 0;
+        decide(best, bestTime);
+        _settle = _threads == previous ? std::min(_settle * 2, MAX_SETTLE) : SETTLE;
+        return _threads != previous;
+    }
+
+private:
+    static constexpr size_t TRIALS = 3;        // rounds per count
+    static constexpr double CHANGE = 2.0;      // round time factor that starts new trials
+    static constexpr double SMOOTHING = 0.1;   // weight of the last round in the average
+    static constexpr int SETTLE = 16;          // rounds kept before trying again
+    static constexpr int MAX_SETTLE = 1024;    // ... at most, after trials that changed nothing
+
+    void decide(size_t candidate, double seconds) {
+        _trying = false;
+        _decided = true;
+        _threads = _candidates[candidate];
+        _baseline = _average = seconds;
+        _steadyRounds = 0;
+    }
+
+    void startTrials() {
+        if (_candidates.size() == 1) return;
+        _trying = true;
+        _next = 0;
+        for (auto& s : _samples) s.clear();
+    }
+
+    std::vector<int> _candidates;
+    std::vector<std::vector<double>> _samples;   // round times of each count in this trial
+    bool _trying{true};
+    size_t _next{0};       // count tried next
+    int _threads{1};       // the count kept
+    double _baseline{0};   // median round time when it was kept
+    double _average{0};    // smoothed round time since
+    int _steadyRounds{0};
+    int _settle{SETTLE};   // rounds before the next trial may start
+    bool _decided{false};
+};
+
+} // namespace quantas
+
+#endif /* THREAD_TUNER_HPP */
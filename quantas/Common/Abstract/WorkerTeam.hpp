@@ -0,0 +1,157 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// A fixed team of threads for the round phases ("executor": "team").
+//
+// The thread pool hands every phase over as tasks: a future per block, a
+// locked queue and a condition variable to wake the workers. The team instead
+// keeps its threads waiting at a barrier. The calling thread publishes the
+// phase, joins the barrier as member 0, runs its own share and waits at the
+// barrier again for the others. Nothing is allocated or queued per phase.
+//
+// The barrier spins for a while before it parks a thread, so short rounds do
+// not pay for a sleep and a wake-up. It only spins when every member can
+// have a core of its own; otherwise a spinning thread would take the core
+// that the thread it waits for needs.
+
+#ifndef WORKER_TEAM_HPP
+#define WORKER_TEAM_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+#include <immintrin.h>
+#endif
+
+namespace quantas {
+
+// Sense-reversing barrier: each member flips its own sense on arrival and
+// the last to arrive flips the shared one, which releases the others. The
+// others spin on it up to spins times, then sleep until it flips.
+class SpinBarrier {
+public:
+    SpinBarrier(int members, int spins) : _members(members), _waiting(members), _spins(spins) {}
+
+    // sense is the calling member's own, false before its first wait
+    void wait(bool& sense) {
+        sense = !sense;
+        if (_waiting.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            _waiting.store(_members, std::memory_order_relaxed);
+            _sense.store(sense, std::memory_order_seq_cst);
+            // a member that went to sleep after the flip saw it and did not
+            // sleep; one that went before is seen here
+            if (_sleeping.load(std::memory_order_seq_cst) > 0) {
+                { std::lock_guard<std::mutex> lock(_mutex); }
+                _wake.notify_all();
+            }
+            return;
+        }
+        for (int i = 0; i < _spins; ++i) {
+            if (_sense.load(std::memory_order_acquire) == sense) return;
+            pause();
+        }
+        std::unique_lock<std::mutex> lock(_mutex);
+        _sleeping.fetch_add(1, std::memory_order_seq_cst);
+        while (_sense.load(std::memory_order_seq_cst) != sense) _wake.wait(lock);
+        _sleeping.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+private:
+    static void pause() {
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) || defined(_M_IX86)
+        _mm_pause();
+#else
+        std::this_thread::yield();
+#endif
+    }
+
+    const int _members;
+    std::atomic<int> _waiting;
+    std::atomic<bool> _sense{false};
+    std::atomic<int> _sleeping{0};
+    const int _spins;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+};
+
+class WorkerTeam {
+public:
+    // members threads in all, the one calling run() among them
+    explicit WorkerTeam(int members)
+        : _members(std::max(1, members)),
+          _barrier(_members, int(std::thread::hardware_concurrency()) >= _members ? SPINS : 0) {
+        for (int m = 1; m < _members; ++m) _threads.emplace_back([this, m]() { work(m); });
+    }
+    ~WorkerTeam() {
+        _stop = true;
+        _barrier.wait(_sense);
+        for (auto& t : _threads) t.join();
+    }
+    WorkerTeam(const WorkerTeam&) = delete;
+    WorkerTeam& operator=(const WorkerTeam&) = delete;
+
+    int size() const { return _members; }
+
+    // calls task(member) once on every member and returns when all are done;
+    // the first exception a member threw is rethrown here
+    template<typename F>
+    void run(F&& task) {
+        _task = &task;
+        _call = [](void* t, int member) { (*static_cast<std::remove_reference_t<F>*>(t))(member); };
+        _barrier.wait(_sense);
+        perform(0);
+        _barrier.wait(_sense);
+        if (_error) std::rethrow_exception(std::exchange(_error, nullptr));
+    }
+
+private:
+    static constexpr int SPINS = 1 << 14;   // a few tens of microseconds
+
+    void work(int member) {
+        bool sense = false;
+        while (true) {
+            _barrier.wait(sense);
+            if (_stop) return;
+            perform(member);
+            _barrier.wait(sense);
+        }
+    }
+
+    void perform(int member) {
+        try {
+            _call(_task, member);
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(_errorMutex);
+            if (!_error) _error = std::current_exception();
+        }
+    }
+
+    const int _members;
+    SpinBarrier _barrier;
+    bool _sense{false};   // the calling thread's
+    std::vector<std::thread> _threads;
+    // the phase, published before the barrier releases the members
+    void* _task{nullptr};
+    void (*_call)(void*, int){nullptr};
+    bool _stop{false};
+    std::exception_ptr _error;
+    std::mutex _errorMutex;
+};
+
+} // namespace quantas
+
+#endif /* WORKER_TEAM_HPP */
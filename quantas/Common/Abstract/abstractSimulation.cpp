@@ -14,12 +14,15 @@
 
 */
 
+#include <atomic>
 #include <iostream>
 #include <fstream>
 #include <set>
 #include <chrono>
 #include <random>
 #include <filesystem>
+#include <thread>
+#include <vector>
 
 #include "Network.hpp"
 #include "Simulation.hpp"
@@ -44,11 +47,30 @@ int main(int argc, const char* argv[]) {
    json config;
    inFile >> config;
 
-   for (int i = 0; i < config["experiments"].size(); ++i) {
-      json input = config["experiments"][i];
-      quantas::Simulation sim;
-	   sim.run(input);
+   // number of experiments run at the same time, each in its own simulation
+   int experiments = static_cast<int>(config["experiments"].size());
+   int parallelExperiments = std::min(config.value("parallelExperiments", 1), experiments);
+   if (parallelExperiments <= 1) {
+      for (int i = 0; i < experiments; ++i) {
+         json input = config["experiments"][i];
+         quantas::Simulation sim;
+         sim.run(input);
+      }
+      return 0;
    }
 
+   std::atomic<int> nextExperiment{0};
+   std::vector<std::thread> workers;
+   for (int w = 0; w < parallelExperiments; ++w) {
+      workers.emplace_back([&config, &nextExperiment, experiments]() {
+         for (int i = nextExperiment++; i < experiments; i = nextExperiment++) {
+            json input = config["experiments"][i];
+            quantas::Simulation sim;
+            sim.run(input);
+         }
+      });
+   }
+   for (auto& worker : workers) worker.join();
+
    return 0;
 }
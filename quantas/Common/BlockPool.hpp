@@ -0,0 +1,232 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Slab pool of small fixed-size blocks for the objects created for every
+// message sent (the shared json bodies and typed payloads of packets). Each
+// thread allocates from and frees to its own free list, so worker threads do
+// not contend on malloc; slabs are only taken from the shared pool when a
+// thread's list runs dry.
+//
+// A block may be freed by a different thread than the one that allocated it
+// (packets are built by the sender and destroyed by the receiver). It then
+// simply joins the freeing thread's list, and lists that grow too long hand
+// blocks back to the shared pool.
+//
+// reset() releases every slab once no block is in use; a simulation calls it
+// between tests when no other simulation is running.
+
+#ifndef BLOCK_POOL_HPP
+#define BLOCK_POOL_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace quantas {
+
+class BlockPool {
+public:
+    static constexpr size_t BLOCK_SIZE = 64;
+    static constexpr size_t BLOCKS_PER_SLAB = 1024;
+
+    static void* allocate(size_t size) {
+        if (size > BLOCK_SIZE) return ::operator new(size);
+        ThreadCache& c = cache();
+        c.sync();
+        if (c.free == nullptr) instance()->refill(c);
+        Node* n = c.free;
+        c.free = n->next;
+        --c.freeCount;
+        c.live.store(c.live.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+        return n;
+    }
+
+    static void deallocate(void* p, size_t size) {
+        if (size > BLOCK_SIZE) {
+            ::operator delete(p);
+            return;
+        }
+        ThreadCache& c = cache();
+        c.sync();
+        Node* n = static_cast<Node*>(p);
+        n->next = c.free;
+        c.free = n;
+        ++c.freeCount;
+        c.live.store(c.live.load(std::memory_order_relaxed) - 1, std::memory_order_relaxed);
+        if (c.freeCount > 4 * BLOCKS_PER_SLAB) instance()->donate(c);
+    }
+
+    // Release all slabs if no block is in use. Must not race with allocations
+    // (call it while worker threads are idle). Returns false if blocks are live.
+    static bool reset() {
+        BlockPool* inst = instance();
+        std::lock_guard<std::mutex> lock(inst->_mtx);
+        long live = inst->_retiredLive;
+        for (ThreadCache* c : inst->_caches) live += c->live.load(std::memory_order_relaxed);
+        if (live != 0) return false;
+        for (void* slab : inst->_slabs) ::operator delete(slab);
+        inst->_slabs.clear();
+        inst->_shared = nullptr;
+        inst->_sharedCount = 0;
+        inst->_generation.fetch_add(1, std::memory_order_release);
+        return true;
+    }
+
+    // bytes currently reserved in slabs
+    static size_t reservedBytes() {
+        BlockPool* inst = instance();
+        std::lock_guard<std::mutex> lock(inst->_mtx);
+        return inst->_slabs.size() * BLOCKS_PER_SLAB * BLOCK_SIZE;
+    }
+
+private:
+    union Node {
+        Node* next;
+        alignas(std::max_align_t) unsigned char storage[BLOCK_SIZE];
+    };
+
+    struct ThreadCache {
+        Node* free{nullptr};
+        size_t freeCount{0};
+        size_t generation{0};
+        std::atomic<long> live{0}; // blocks allocated minus blocks freed by this thread
+
+        ThreadCache() {
+            BlockPool* inst = instance();
+            std::lock_guard<std::mutex> lock(inst->_mtx);
+            generation = inst->_generation.load(std::memory_order_relaxed);
+            inst->_caches.push_back(this);
+        }
+        ~ThreadCache() {
+            BlockPool* inst = instance();
+            std::lock_guard<std::mutex> lock(inst->_mtx);
+            inst->_retiredLive += live.load(std::memory_order_relaxed);
+            if (generation == inst->_generation.load(std::memory_order_relaxed)) {
+                inst->pushShared(free, freeCount);
+            }
+            inst->_caches.erase(std::find(inst->_caches.begin(), inst->_caches.end(), this));
+        }
+
+        // drop the list if the slabs behind it were released by reset()
+        void sync() {
+            size_t g = instance()->_generation.load(std::memory_order_acquire);
+            if (generation != g) {
+                free = nullptr;
+                freeCount = 0;
+                generation = g;
+            }
+        }
+    };
+
+    static BlockPool* instance() {
+        static BlockPool s;
+        return &s;
+    }
+
+    static ThreadCache& cache() {
+        thread_local ThreadCache c;
+        return c;
+    }
+
+    // give the thread a batch of blocks, from the shared list or a new slab
+    void refill(ThreadCache& c) {
+        std::lock_guard<std::mutex> lock(_mtx);
+        if (_shared != nullptr) {
+            Node* last = _shared;
+            size_t count = 1;
+            while (count < BLOCKS_PER_SLAB && last->next != nullptr) {
+                last = last->next;
+                ++count;
+            }
+            c.free = _shared;
+            _shared = last->next;
+            last->next = nullptr;
+            c.freeCount = count;
+            _sharedCount -= count;
+            return;
+        }
+        Node* slab = static_cast<Node*>(::operator new(sizeof(Node) * BLOCKS_PER_SLAB));
+        _slabs.push_back(slab);
+        for (size_t i = 0; i + 1 < BLOCKS_PER_SLAB; ++i) slab[i].next = &slab[i + 1];
+        slab[BLOCKS_PER_SLAB - 1].next = nullptr;
+        c.free = slab;
+        c.freeCount = BLOCKS_PER_SLAB;
+    }
+
+    // move a slab's worth of blocks from a long thread list to the shared list
+    void donate(ThreadCache& c) {
+        Node* first = c.free;
+        Node* last = first;
+        for (size_t i = 1; i < BLOCKS_PER_SLAB; ++i) last = last->next;
+        c.free = last->next;
+        c.freeCount -= BLOCKS_PER_SLAB;
+        last->next = nullptr;
+        std::lock_guard<std::mutex> lock(_mtx);
+        pushShared(first, BLOCKS_PER_SLAB);
+    }
+
+    // requires _mtx
+    void pushShared(Node* first, size_t count) {
+        if (first == nullptr) return;
+        Node* last = first;
+        while (last->next != nullptr) last = last->next;
+        last->next = _shared;
+        _shared = first;
+        _sharedCount += count;
+    }
+
+    BlockPool() {}
+    ~BlockPool() {
+        for (void* slab : _slabs) ::operator delete(slab);
+    }
+    BlockPool(const BlockPool&) = delete;
+    BlockPool& operator=(const BlockPool&) = delete;
+
+    std::mutex _mtx;
+    std::vector<void*> _slabs;
+    std::vector<ThreadCache*> _caches;
+    Node* _shared{nullptr};       // blocks handed back by threads
+    size_t _sharedCount{0};
+    long _retiredLive{0};         // live count of threads that have exited
+    std::atomic<size_t> _generation{0};
+};
+
+// std allocator on top of BlockPool, e.g. for std::allocate_shared
+template<typename T>
+class PoolAllocator {
+public:
+    typedef T value_type;
+
+    PoolAllocator() = default;
+    template<typename U>
+    PoolAllocator(const PoolAllocator<U>&) {}
+
+    T* allocate(size_t n) {
+        if (alignof(T) > alignof(std::max_align_t)) return std::allocator<T>().allocate(n);
+        return static_cast<T*>(BlockPool::allocate(n * sizeof(T)));
+    }
+
+    void deallocate(T* p, size_t n) {
+        if (alignof(T) > alignof(std::max_align_t)) return std::allocator<T>().deallocate(p, n);
+        BlockPool::deallocate(p, n * sizeof(T));
+    }
+
+    template<typename U>
+    bool operator==(const PoolAllocator<U>&) const { return true; }
+    template<typename U>
+    bool operator!=(const PoolAllocator<U>&) const { return false; }
+};
+
+} // namespace quantas
+
+#endif /* BLOCK_POOL_HPP */
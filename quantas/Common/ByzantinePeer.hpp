@@ -54,35 +54,55 @@ inline ByzantinePeer() {}
     virtual void unicastTo (json msg, const interfaceId& dest) override { 
         bool skipRegular = faultManager.applyUnicastTo(this, msg, dest);
         if (!skipRegular) 
-            _networkInterface->unicastTo(msg, dest);
+            _networkInterface->unicastTo(std::move(msg), dest);
     };
 
     virtual void unicast (json msg) override { 
         bool skipRegular = faultManager.applySend(this, msg, "unicast");
         if (!skipRegular) 
-            _networkInterface->unicast(msg);
+            _networkInterface->unicast(std::move(msg));
     };
 
     virtual void multicast (json msg, const std::set<interfaceId>& targets) override { 
         bool skipRegular = faultManager.applySend(this, msg, "multicast", targets);
         if (!skipRegular) 
-            _networkInterface->multicast(msg, targets);
+            _networkInterface->multicast(std::move(msg), targets);
     };
 
     virtual void broadcast (json msg) override { 
         bool skipRegular = faultManager.applySend(this, msg, "broadcast");
         if (!skipRegular) 
-            _networkInterface->broadcast(msg);
+            _networkInterface->broadcast(std::move(msg));
     };
 
     virtual void broadcastBut (json msg, const interfaceId& id) override { 
-        _networkInterface->broadcastBut(msg, id); 
+        _networkInterface->broadcastBut(std::move(msg), id); 
     };
 
     virtual void randomMulticast (json msg) override { 
         bool skipRegular = faultManager.applySend(this, msg, "randomMulticast");
         if (!skipRegular) 
-            _networkInterface->randomMulticast(msg);
+            _networkInterface->randomMulticast(std::move(msg));
+    };
+
+    // Typed messages only become json when a fault needs to inspect them
+    virtual void unicastPayloadTo (const Payload& msg, const interfaceId& dest) override {
+        if (faultManager.hasUnicastToFaults())
+            unicastTo(msg.toJson(), dest);
+        else
+            _networkInterface->unicastPayloadTo(msg, dest);
+    };
+    virtual void multicastPayload (const Payload& msg, const std::set<interfaceId>& targets) override {
+        if (faultManager.hasSendFaults("multicast"))
+            multicast(msg.toJson(), targets);
+        else
+            _networkInterface->multicastPayload(msg, targets);
+    };
+    virtual void broadcastPayload (const Payload& msg) override {
+        if (faultManager.hasSendFaults("broadcast"))
+            broadcast(msg.toJson());
+        else
+            _networkInterface->broadcastPayload(msg);
     };
 
     // moves msgs to the inStream if they've arrived
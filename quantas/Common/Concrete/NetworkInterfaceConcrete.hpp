@@ -218,7 +218,7 @@ private:
                         }
                     }
                 } else if (type == "message") {
-                    std::lock_guard<std::mutex> lock(_inStream_mtx);
+                    // the listener is the only producer for the inStream
                     interfaceId sender = msg.value("from_id", -1);
                     if (sender == -1) continue;
                     Packet arrivedPkt(_publicId, sender, msg["body"]);
@@ -342,7 +342,7 @@ public:
         std::cout << "wait_for_tasks" << std::endl;
         _inStream.clear();
         std::cout << "_inStream" << std::endl;
-        _neighbors.clear();
+        clearNeighbors();
         std::cout << "_neighbors" << std::endl;
         all_peers.clear();
         std::cout << "all_peers" << std::endl;
@@ -350,7 +350,7 @@ public:
 };
 
 void NetworkInterfaceConcrete::unicastTo(json msg, const interfaceId& nbr) {
-    if (_neighbors.find(nbr) == _neighbors.end()) return;
+    if (!isNeighbor(nbr)) return;
     json newMsg = {
         {"type", "message"},
         {"from_id", _publicId},
@@ -84,6 +84,12 @@ public:
         }
     }
 
+    bool hasUnicastToFaults() const { return !unicastToFaults.empty(); }
+    bool hasSendFaults(const std::string& sendType) const {
+        auto it = sendFaults.find(sendType);
+        return it != sendFaults.end() && !it->second.empty();
+    }
+
     bool applyUnicastTo(Peer* peer, json& msg, const interfaceId& dest) {
         bool overridden = false;
         for (auto* f : unicastToFaults)
@@ -0,0 +1,125 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Topologies whose neighbors are a function of the peer's index: complete,
+// ring, chain, grid and torus. Instead of storing every edge the network can
+// hand each interface this description and the interface's index, and
+// neighbor lists are computed on demand (see NeighborView). The neighbors are
+// the same, in the same ascending order, as the ones Network's builders add.
+
+#ifndef IMPLICIT_TOPOLOGY_HPP
+#define IMPLICIT_TOPOLOGY_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <string>
+#include "Packet.hpp"
+
+namespace quantas {
+
+class ImplicitTopology {
+public:
+    enum class Kind { COMPLETE, RING, CHAIN, GRID, TORUS };
+
+    // true if type (a topology "type") has an arithmetic form
+    static bool supports(const std::string& type) {
+        return type == "complete" || type == "ring" || type == "chain" || type == "grid" || type == "torus";
+    }
+
+    ImplicitTopology(const std::string& type, interfaceId peers, interfaceId height, interfaceId width)
+    : _peers(peers), _height(height), _width(width) {
+        if (type == "complete") _kind = Kind::COMPLETE;
+        else if (type == "ring") _kind = Kind::RING;
+        else if (type == "chain") _kind = Kind::CHAIN;
+        else if (type == "grid") _kind = Kind::GRID;
+        else _kind = Kind::TORUS;
+    }
+
+    interfaceId peers() const { return _peers; }
+
+    size_t degree(interfaceId node) const {
+        if (_kind == Kind::COMPLETE) return _peers > 1 ? static_cast<size_t>(_peers - 1) : 0;
+        interfaceId nbrs[4];
+        return sparse(node, nbrs);
+    }
+
+    // the j-th smallest neighbor of node, j < degree(node)
+    interfaceId neighbor(interfaceId node, size_t j) const {
+        if (_kind == Kind::COMPLETE) {
+            interfaceId id = static_cast<interfaceId>(j);
+            return id < node ? id : id + 1;
+        }
+        interfaceId nbrs[4];
+        sparse(node, nbrs);
+        return nbrs[j];
+    }
+
+    // position of nbr among the neighbors of node, -1 if they are not adjacent
+    long indexOf(interfaceId node, interfaceId nbr) const {
+        if (_kind == Kind::COMPLETE) {
+            if (nbr == node || nbr < 0 || nbr >= _peers) return -1;
+            return nbr < node ? nbr : nbr - 1;
+        }
+        interfaceId nbrs[4];
+        size_t count = sparse(node, nbrs);
+        for (size_t j = 0; j < count; ++j) {
+            if (nbrs[j] == nbr) return static_cast<long>(j);
+        }
+        return -1;
+    }
+
+private:
+    // neighbors of node in the sparse topologies, ascending and without repeats
+    size_t sparse(interfaceId node, interfaceId out[4]) const {
+        size_t count = 0;
+        switch (_kind) {
+        case Kind::RING:
+            if (_peers > 1) {
+                out[count++] = (node + _peers - 1) % _peers;
+                out[count++] = (node + 1) % _peers;
+            }
+            break;
+        case Kind::CHAIN:
+            if (node > 0) out[count++] = node - 1;
+            if (node + 1 < _peers) out[count++] = node + 1;
+            break;
+        case Kind::GRID: {
+            if (node >= _height * _width) break;
+            interfaceId row = node / _width, col = node % _width;
+            if (row > 0) out[count++] = node - _width;
+            if (col > 0) out[count++] = node - 1;
+            if (col + 1 < _width) out[count++] = node + 1;
+            if (row + 1 < _height) out[count++] = node + _width;
+            break;
+        }
+        case Kind::TORUS: {
+            if (node >= _height * _width) break;
+            interfaceId row = node / _width, col = node % _width;
+            out[count++] = row * _width + (col + 1) % _width;
+            out[count++] = row * _width + (col + _width - 1) % _width;
+            out[count++] = ((row + 1) % _height) * _width + col;
+            out[count++] = ((row + _height - 1) % _height) * _width + col;
+            break;
+        }
+        case Kind::COMPLETE:
+            break;
+        }
+        std::sort(out, out + count);
+        return static_cast<size_t>(std::unique(out, out + count) - out);
+    }
+
+    Kind _kind{Kind::COMPLETE};
+    interfaceId _peers{0};
+    interfaceId _height{1};
+    interfaceId _width{1};
+};
+
+} // namespace quantas
+
+#endif /* IMPLICIT_TOPOLOGY_HPP */
@@ -1,11 +1,21 @@
 #ifndef LogWriter_hpp
 #define LogWriter_hpp
 
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstdint>
 #include <string>
 #include <fstream>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
 #include "Json.hpp"
+#include "RoundManager.hpp"
 
 namespace quantas {
 
@@ -13,18 +23,68 @@ namespace quantas {
 
     class LogWriter {
     public:
+        // "json" (default): everything is kept and written as one document by
+        // print(). "ndjson": every value is written as a line
+        // {"test", "round", "metric", "value"} as it is logged. "csv": every
+        // metric is written as it is logged to <log file stem>_<metric>.csv
+        // (test,round,value), experiment values to the log file (metric,value).
+        enum class Format { JSON, NDJSON, CSV };
+
+        // Every simulation owns one; the static functions below write to the
+        // one bound to the calling thread and fall back to a process wide log.
+        LogWriter() : _id(++s_lastId) {}
+        LogWriter(const LogWriter&) = delete;
+        LogWriter& operator=(const LogWriter&) = delete;
+
         static LogWriter* instance() {
+            if (t_bound != nullptr) return t_bound;
             static LogWriter s;
             return &s;
         }
 
-        // Set log file path and open stream
-        static void setLogFile(const std::string& path) {
+        // binds a LogWriter to the calling thread for the lifetime of the scope
+        class Scope {
+        public:
+            explicit Scope(LogWriter* bound) : _previous(t_bound) { t_bound = bound; }
+            ~Scope() { t_bound = _previous; }
+            Scope(const Scope&) = delete;
+            Scope& operator=(const Scope&) = delete;
+        private:
+            LogWriter* _previous;
+        };
+
+        // While one is alive, values pushed to the current log from any
+        // thread go to that thread's own buffer instead of taking the log's
+        // lock. When it ends (the threads it covers are done) the buffers
+        // are merged in the order of the peers that logged (see setSource),
+        // which is the order one thread running every peer would log in.
+        class Buffered {
+        public:
+            Buffered() : _log(instance()) { _log->_buffering.store(true, std::memory_order_relaxed); }
+            ~Buffered() { _log->mergeBuffers(); }
+            Buffered(const Buffered&) = delete;
+            Buffered& operator=(const Buffered&) = delete;
+        private:
+            LogWriter* _log;
+        };
+
+        // the peer the calling thread acts for, orders its buffered values
+        static void setSource(uint32_t source) { t_source = source; }
+
+        // Set log file path and format ("json", "ndjson" or "csv") and open stream
+        static void setLogFile(const std::string& path, const std::string& format = "json") {
             LogWriter* inst = instance();
             std::lock_guard<std::mutex> lock(inst->_mutex);
+            inst->closeStreams();
 
-            if (inst->_file_stream.is_open()) {
-                inst->_file_stream.close();
+            inst->_format = Format::JSON;
+            if (format == "ndjson") {
+                inst->_format = Format::NDJSON;
+            } else if (format == "csv") {
+                inst->_format = path == "cout" ? Format::NDJSON : Format::CSV;
+                if (path == "cout") std::cerr << "[LogWriter] csv needs a log file, writing ndjson to std::cout.\n";
+            } else if (format != "json") {
+                std::cerr << "[LogWriter] Unknown log format: " << format << ". Using json.\n";
             }
 
             if (path == "cout") {
@@ -36,30 +96,44 @@ namespace quantas {
 
             if (inst->_file_stream.is_open()) {
                 inst->_log_stream = &inst->_file_stream;
+                inst->_csvStem = stem(path);
             } else {
                 std::cerr << "[LogWriter] Failed to open log file: " << path << ". Falling back to std::cout.\n";
                 inst->_log_stream = &std::cout;
+                if (inst->_format == Format::CSV) inst->_format = Format::NDJSON;
             }
+            if (inst->_format == Format::CSV) inst->emit("metric,value\n");
+        }
+
+        // Logs of the tests a simulation runs side by side are written through
+        // parent when parent writes a stream, and merged into it otherwise.
+        void streamThrough(LogWriter* parent) {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _parent = parent;
         }
 
         static void print() {
             LogWriter* inst = instance();
             std::lock_guard<std::mutex> lock(inst->_mutex);
-            if (inst->_log_stream != nullptr) {
+            if (inst->_format != Format::JSON) {
+                // everything has been written already
+            } else if (inst->_log_stream == &std::cout) {
+                // logs of simulations running side by side share the console
+                std::lock_guard<std::mutex> coutLock(coutMutex());
+                std::cout << inst->data.dump(4) << std::endl;
+            } else if (inst->_log_stream != nullptr) {
                 (*inst->_log_stream) << inst->data.dump(4) << std::endl;
-                inst->_log_stream->flush();
             }
             inst->data.clear();
-            if (inst->_file_stream.is_open()) {
-                inst->_file_stream.close();
-            }
-            inst->_log_stream = nullptr;
+            inst->closeStreams();
         }
 
         static void setTest(int test) {
             LogWriter* inst = instance();
             std::lock_guard<std::mutex> lock(inst->_mutex);
             inst->_test = test;
+            // what the last test streamed is on disk before the next starts
+            inst->flushStreams();
         }
 
         static int getTest() {
@@ -71,28 +145,189 @@ namespace quantas {
         template <typename T>
         static void pushValue(const std::string& key, const T& val) {
             LogWriter* inst = instance();
+            if (inst->_buffering.load(std::memory_order_relaxed)) {
+                inst->threadBuffer().push_back(Entry{t_source, inst->_test, RoundManager::currentRound(), key, val});
+                return;
+            }
             std::lock_guard<std::mutex> lock(inst->_mutex);
-            inst->data["tests"][inst->_test][key].push_back(val);
+            inst->record(Entry{t_source, inst->_test, RoundManager::currentRound(), key, val});
         }
 
         template <typename T>
         static void setValue(const std::string& key, const T& val) {
             LogWriter* inst = instance();
             std::lock_guard<std::mutex> lock(inst->_mutex);
-            inst->data[key] = val;
+            if (inst->_format == Format::JSON) {
+                inst->data[key] = val;
+            } else {
+                inst->writeValue(key, val);
+            }
+        }
+
+        // Moves everything other logged into the current log: the tests it
+        // recorded keep their index, top level values overwrite.
+        static void merge(LogWriter& other) {
+            LogWriter* inst = instance();
+            std::scoped_lock lock(inst->_mutex, other._mutex);
+            for (auto it = other.data.begin(); it != other.data.end(); ++it) {
+                if (it.key() != "tests") {
+                    inst->data[it.key()] = std::move(it.value());
+                    continue;
+                }
+                json& tests = it.value();
+                for (size_t test = 0; test < tests.size(); ++test) {
+                    if (!tests[test].is_null()) {
+                        inst->data["tests"][test] = std::move(tests[test]);
+                    }
+                }
+            }
+            other.data.clear();
         }
 
     private:
+        struct Entry {
+            uint32_t source;
+            int test;
+            size_t round;
+            std::string key;
+            json value;
+        };
+
+        static inline thread_local LogWriter* t_bound = nullptr;
+        static inline thread_local uint32_t t_source = 0;
+        static inline std::atomic<uint64_t> s_lastId{0};
+
+        static std::mutex& coutMutex() {
+            static std::mutex m;
+            return m;
+        }
+
+        // the calling thread's buffer, made on its first value
+        std::vector<Entry>& threadBuffer() {
+            struct Cached { uint64_t owner; std::vector<Entry>* buffer; };
+            static thread_local Cached cached{0, nullptr};
+            if (cached.owner == _id) return *cached.buffer;
+            std::lock_guard<std::mutex> lock(_mutex);
+            std::unique_ptr<std::vector<Entry>>& buffer = _buffers[std::this_thread::get_id()];
+            if (!buffer) buffer.reset(new std::vector<Entry>());
+            cached = Cached{_id, buffer.get()};
+            return *buffer;
+        }
+
+        void mergeBuffers() {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _buffering.store(false, std::memory_order_relaxed);
+            _merging.clear();
+            for (auto& [thread, buffer] : _buffers) {
+                for (Entry& entry : *buffer) _merging.push_back(&entry);
+            }
+            if (_merging.empty()) return;
+            // a peer's values are all in the buffer of the thread that ran it
+            std::stable_sort(_merging.begin(), _merging.end(),
+                             [](const Entry* a, const Entry* b) { return a->source < b->source; });
+            for (Entry* entry : _merging) record(std::move(*entry));
+            _merging.clear();
+            for (auto& [thread, buffer] : _buffers) buffer->clear();
+        }
+
+        // keeps or writes one value, with _mutex held
+        void record(Entry&& entry) {
+            if (_parent != nullptr && _parent->_format != Format::JSON) {
+                std::lock_guard<std::mutex> lock(_parent->_mutex);
+                _parent->write(entry);
+            } else if (_format == Format::JSON) {
+                data["tests"][entry.test][entry.key].push_back(std::move(entry.value));
+            } else {
+                write(entry);
+            }
+        }
+
+        void write(const Entry& entry) {
+            if (_log_stream == nullptr) return;
+            if (_format == Format::NDJSON) {
+                emit("{\"test\":" + std::to_string(entry.test) + ",\"round\":" + std::to_string(entry.round)
+                     + ",\"metric\":" + json(entry.key).dump() + ",\"value\":" + entry.value.dump() + "}\n");
+                return;
+            }
+            std::unique_ptr<std::ofstream>& file = _csvFiles[entry.key];
+            if (!file) {
+                std::string name = entry.key;
+                for (char& c : name) {
+                    if (!std::isalnum(static_cast<unsigned char>(c)) && c != '-') c = '_';
+                }
+                file.reset(new std::ofstream(_csvStem + "_" + name + ".csv"));
+                (*file) << "test,round,value\n";
+            }
+            (*file) << entry.test << ',' << entry.round << ',' << csvField(entry.value) << '\n';
+        }
+
+        void writeValue(const std::string& key, const json& value) {
+            if (_log_stream == nullptr) return;
+            if (_format == Format::NDJSON) {
+                emit("{\"metric\":" + json(key).dump() + ",\"value\":" + value.dump() + "}\n");
+            } else {
+                emit(csvField(key) + ',' + csvField(value) + '\n');
+            }
+        }
+
+        // whole lines, so logs sharing the console do not mix within one
+        void emit(const std::string& text) {
+            if (_log_stream == &std::cout) {
+                std::lock_guard<std::mutex> coutLock(coutMutex());
+                std::cout << text;
+            } else {
+                (*_log_stream) << text;
+            }
+        }
+
+        // path without its extension
+        static std::string stem(const std::string& path) {
+            size_t dot = path.find_last_of('.');
+            size_t slash = path.find_last_of("/\\");
+            if (dot == std::string::npos || (slash != std::string::npos && dot < slash)) return path;
+            return path.substr(0, dot);
+        }
+
+        // numbers and booleans as they are, anything else quoted
+        static std::string csvField(const json& value) {
+            if (value.is_number() || value.is_boolean()) return value.dump();
+            std::string text = value.is_string() ? value.get<std::string>() : value.dump();
+            std::string quoted = "\"";
+            for (char c : text) {
+                if (c == '"') quoted += '"';
+                quoted += c;
+            }
+            return quoted + "\"";
+        }
+
+        void flushStreams() {
+            if (_log_stream != nullptr && _format != Format::JSON) _log_stream->flush();
+            for (auto& [key, file] : _csvFiles) file->flush();
+        }
+
+        void closeStreams() {
+            if (_log_stream != nullptr) _log_stream->flush();
+            _csvFiles.clear();
+            if (_file_stream.is_open()) {
+                _file_stream.close();
+            }
+            _log_stream = nullptr;
+        }
+
+        const uint64_t _id;
         std::ofstream _file_stream;
         std::ostream* _log_stream = nullptr;
+        Format _format = Format::JSON;
+        std::string _csvStem;
+        std::map<std::string, std::unique_ptr<std::ofstream>> _csvFiles;
+        LogWriter* _parent = nullptr;
         int _test = 0;
         json data;
         mutable std::mutex _mutex;
 
-        // disallow copies
-        LogWriter() = default;
-        LogWriter(const LogWriter&) = delete;
-        LogWriter& operator=(const LogWriter&) = delete;
+        std::atomic<bool> _buffering{false};
+        std::map<std::thread::id, std::unique_ptr<std::vector<Entry>>> _buffers;
+        std::vector<Entry*> _merging;
     };
 
 } // namespace quantas
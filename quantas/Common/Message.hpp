@@ -0,0 +1,225 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Typed message payloads, an alternative to the json body of a Packet for
+// messages sent on the hot path. A message type is any trivially copyable
+// struct registered once under a name:
+//
+//     struct TxMessage { int id; int round; };
+//     static messageTag txTag = MessageRegistry::registerMessageType<TxMessage>(
+//         "TxMessage", [](const TxMessage& m) { return json{{"id", m.id}}; });
+//
+// A Payload holds a copy of the struct plus its small tag, in a pooled block
+// shared by every copy of the Payload. The optional json converter
+// is used wherever a json view of the message is still needed (faults,
+// Packet::getMessage, the concrete socket interface).
+
+#ifndef MESSAGE_HPP
+#define MESSAGE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "Json.hpp"
+#include "BlockPool.hpp"
+
+namespace quantas {
+
+using nlohmann::json;
+
+typedef uint16_t messageTag;
+
+inline static const messageTag NO_MESSAGE_TAG = 0; // payload is empty, the packet carries json
+
+class MessageRegistry {
+public:
+    // Register T and return its tag. Registering the same type twice returns the existing tag.
+    template<typename T>
+    static messageTag registerMessageType(const std::string& name,
+                                          std::function<json(const T&)> toJson = nullptr) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "message types must be trivially copyable");
+        messageTag& tag = tagSlot<T>();
+        if (tag != NO_MESSAGE_TAG) return tag;
+
+        MessageRegistry* inst = instance();
+        if (inst->entries.size() >= UINT16_MAX) {
+            throw std::runtime_error("Too many message types registered");
+        }
+        Entry entry;
+        entry.name = name;
+        entry.size = sizeof(T);
+        if (toJson) {
+            entry.toJson = [toJson](const void* data) {
+                T msg;
+                std::memcpy(&msg, data, sizeof(T));
+                return toJson(msg);
+            };
+        }
+        inst->entries.push_back(entry);
+        tag = static_cast<messageTag>(inst->entries.size());
+        return tag;
+    }
+
+    // tag of T, NO_MESSAGE_TAG if it was never registered
+    template<typename T>
+    static messageTag tagOf() { return tagSlot<T>(); }
+
+    static const std::string& name(messageTag tag) { return entry(tag).name; }
+
+    static bool hasJson(messageTag tag) { return static_cast<bool>(entry(tag).toJson); }
+
+    static json toJson(messageTag tag, const void* data) {
+        const Entry& e = entry(tag);
+        if (!e.toJson) {
+            throw std::runtime_error("Message type " + e.name + " has no json conversion");
+        }
+        return e.toJson(data);
+    }
+
+private:
+    struct Entry {
+        std::string name;
+        size_t size{0};
+        std::function<json(const void*)> toJson;
+    };
+
+    static MessageRegistry* instance() {
+        static MessageRegistry s;
+        return &s;
+    }
+
+    template<typename T>
+    static messageTag& tagSlot() {
+        static messageTag tag = NO_MESSAGE_TAG;
+        return tag;
+    }
+
+    static const Entry& entry(messageTag tag) {
+        MessageRegistry* inst = instance();
+        if (tag == NO_MESSAGE_TAG || tag > inst->entries.size()) {
+            throw std::runtime_error("Unknown message tag: " + std::to_string(tag));
+        }
+        return inst->entries[tag - 1];
+    }
+
+    MessageRegistry() {}
+    MessageRegistry(const MessageRegistry&) = delete;
+    MessageRegistry& operator=(const MessageRegistry&) = delete;
+
+    std::vector<Entry> entries;
+};
+
+// A copy of one registered message struct, tagged with its type. The copy
+// lives out of line in a block from the thread's BlockPool and is never
+// changed, so copies of a Payload (one per recipient of a broadcast, one per
+// packet duplicated by a channel) share the block and only count references.
+class Payload {
+public:
+    Payload() = default;
+
+    template<typename T>
+    explicit Payload(const T& msg) {
+        static_assert(std::is_trivially_copyable<T>::value,
+                      "message types must be trivially copyable");
+        messageTag tag = MessageRegistry::tagOf<T>();
+        if (tag == NO_MESSAGE_TAG) {
+            throw std::runtime_error("Message type used before it was registered");
+        }
+        _block = Block::create(tag, &msg, sizeof(T));
+    }
+
+    Payload(const Payload& rhs) noexcept : _block(rhs._block) {
+        if (_block) _block->refs.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    Payload& operator=(const Payload& rhs) noexcept {
+        Payload copy(rhs);
+        std::swap(_block, copy._block);
+        return *this;
+    }
+
+    Payload(Payload&& rhs) noexcept : _block(std::exchange(rhs._block, nullptr)) {}
+
+    Payload& operator=(Payload&& rhs) noexcept {
+        if (this != &rhs) {
+            release();
+            _block = std::exchange(rhs._block, nullptr);
+        }
+        return *this;
+    }
+
+    ~Payload() { release(); }
+
+    bool empty() const { return _block == nullptr; }
+    messageTag tag() const { return _block ? _block->tag : NO_MESSAGE_TAG; }
+
+    template<typename T>
+    bool holds() const { return !empty() && _block->tag == MessageRegistry::tagOf<T>(); }
+
+    // copy of the stored message, throws if it is not a T
+    template<typename T>
+    T get() const {
+        if (!holds<T>()) {
+            throw std::runtime_error("Payload does not hold the requested message type");
+        }
+        T msg;
+        std::memcpy(&msg, _block->data(), sizeof(T));
+        return msg;
+    }
+
+    json toJson() const {
+        if (empty()) return json();
+        return MessageRegistry::toJson(_block->tag, _block->data());
+    }
+
+private:
+    // header and message in one allocation; structs that fit beside the
+    // header take a single pool block, larger ones come from the heap
+    struct alignas(std::max_align_t) Block {
+        std::atomic<uint32_t> refs;
+        messageTag tag;
+        uint32_t size;
+
+        void* data() { return this + 1; }
+        const void* data() const { return this + 1; }
+
+        static Block* create(messageTag tag, const void* src, size_t size) {
+            void* memory = BlockPool::allocate(sizeof(Block) + size);
+            Block* b = ::new (memory) Block{{1}, tag, static_cast<uint32_t>(size)};
+            std::memcpy(b->data(), src, size);
+            return b;
+        }
+    };
+
+    void release() noexcept {
+        Block* b = std::exchange(_block, nullptr);
+        // the last holder frees it; acq_rel orders the other holders' reads before
+        if (b && b->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            size_t size = sizeof(Block) + b->size;
+            b->~Block();
+            BlockPool::deallocate(b, size);
+        }
+    }
+
+    Block* _block{nullptr};
+};
+
+} // namespace quantas
+
+#endif /* MESSAGE_HPP */
@@ -7,25 +7,136 @@
 #include <deque>
 #include <string>
 #include <algorithm>
+#include <cstddef>
+#include <iterator>
 #include <mutex>
+#include <vector>
 #include "Packet.hpp"
+#include "ImplicitTopology.hpp"
+#include "SpscQueue.hpp"
 
 namespace quantas {
 
+// Read-only view of an interface's neighbors in ascending order: a slice of
+// a sorted array, or computed from an ImplicitTopology. Valid until the
+// neighbors of that interface change.
+class NeighborView {
+public:
+    class const_iterator {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef interfaceId value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef const interfaceId* pointer;
+        typedef interfaceId reference;
+
+        const_iterator() = default;
+        const_iterator(const NeighborView& view, size_t pos)
+        : _first(view._first), _topology(view._topology), _node(view._node), _pos(pos) {}
+
+        interfaceId operator*() const { return _topology != nullptr ? _topology->neighbor(_node, _pos) : _first[_pos]; }
+        interfaceId operator[](difference_type n) const { return *(*this + n); }
+
+        const_iterator& operator++() { ++_pos; return *this; }
+        const_iterator operator++(int) { const_iterator it = *this; ++_pos; return it; }
+        const_iterator& operator--() { --_pos; return *this; }
+        const_iterator operator--(int) { const_iterator it = *this; --_pos; return it; }
+        const_iterator& operator+=(difference_type n) { _pos += n; return *this; }
+        const_iterator& operator-=(difference_type n) { _pos -= n; return *this; }
+        const_iterator operator+(difference_type n) const { const_iterator it = *this; it._pos += n; return it; }
+        const_iterator operator-(difference_type n) const { const_iterator it = *this; it._pos -= n; return it; }
+        difference_type operator-(const const_iterator& rhs) const {
+            return static_cast<difference_type>(_pos) - static_cast<difference_type>(rhs._pos);
+        }
+
+        bool operator==(const const_iterator& rhs) const { return _pos == rhs._pos; }
+        bool operator!=(const const_iterator& rhs) const { return _pos != rhs._pos; }
+        bool operator<(const const_iterator& rhs) const { return _pos < rhs._pos; }
+        bool operator>(const const_iterator& rhs) const { return _pos > rhs._pos; }
+        bool operator<=(const const_iterator& rhs) const { return _pos <= rhs._pos; }
+        bool operator>=(const const_iterator& rhs) const { return _pos >= rhs._pos; }
+
+    private:
+        const interfaceId* _first{nullptr};
+        const ImplicitTopology* _topology{nullptr};
+        interfaceId _node{NO_PEER_ID};
+        size_t _pos{0};
+    };
+    typedef const_iterator iterator;
+
+    NeighborView() = default;
+    NeighborView(const interfaceId* first, const interfaceId* last)
+    : _first(first), _size(static_cast<size_t>(last - first)) {}
+    NeighborView(const ImplicitTopology* topology, interfaceId node)
+    : _topology(topology), _node(node), _size(topology->degree(node)) {}
+
+    const_iterator begin() const { return const_iterator(*this, 0); }
+    const_iterator end() const { return const_iterator(*this, _size); }
+    size_t size() const { return _size; }
+    bool empty() const { return _size == 0; }
+
+    bool contains(interfaceId id) const {
+        if (_topology != nullptr) return _topology->indexOf(_node, id) >= 0;
+        return std::binary_search(_first, _first + _size, id);
+    }
+    // std::set style lookups
+    size_t count(interfaceId id) const { return contains(id) ? 1 : 0; }
+    const_iterator find(interfaceId id) const {
+        if (_topology != nullptr) {
+            long pos = _topology->indexOf(_node, id);
+            return pos >= 0 ? const_iterator(*this, static_cast<size_t>(pos)) : end();
+        }
+        const interfaceId* it = std::lower_bound(_first, _first + _size, id);
+        return (it != _first + _size && *it == id) ? const_iterator(*this, it - _first) : end();
+    }
+
+    operator std::set<interfaceId>() const { return std::set<interfaceId>(begin(), end()); }
+
+private:
+    const interfaceId* _first{nullptr};
+    const ImplicitTopology* _topology{nullptr};
+    interfaceId _node{NO_PEER_ID};
+    size_t _size{0};
+};
+
 class NetworkInterface {
 protected:
     // "Public" ID + unique internal ID
     interfaceId _publicId{NO_PEER_ID};
     interfaceId _internalId{NO_PEER_ID};
 
-    // set of public ids this peer thinks it is currently directly connected to 
-    std::set<interfaceId> _neighbors;
+    // sorted public ids this peer thinks it is currently directly connected to.
+    // Once the network is built they live in the network's shared adjacency
+    // (see useSharedNeighbors) or are computed from an implicit topology (see
+    // useImplicitNeighbors); changing them copies them into _ownNeighbors.
+    const interfaceId* _neighborsBegin{nullptr};
+    const interfaceId* _neighborsEnd{nullptr};
+    const ImplicitTopology* _implicitNeighbors{nullptr};
+    std::vector<interfaceId> _ownNeighbors;
+    bool _sharedNeighbors{false};
 
-    // Our local arrived messages
-    std::deque<Packet> _inStream;
+    inline void pointAtOwnNeighbors() {
+        _neighborsBegin = _ownNeighbors.data();
+        _neighborsEnd = _ownNeighbors.data() + _ownNeighbors.size();
+        _implicitNeighbors = nullptr;
+        _sharedNeighbors = false;
+    }
+    inline void copyOnWriteNeighbors() {
+        if (!_sharedNeighbors) return;
+        NeighborView current = neighbors();
+        _ownNeighbors.assign(current.begin(), current.end());
+        pointAtOwnNeighbors();
+    }
+    inline void clearNeighbors() {
+        _ownNeighbors.clear();
+        pointAtOwnNeighbors();
+    }
 
-    // mutex lock for adding and removing messages from _inStream
-    std::mutex _inStream_mtx;
+    // Our local arrived messages, filled by receive() (or the listener thread)
+    // and emptied by the owning peer
+    SpscQueue<Packet> _inStream;
+    // packets receive() has moved to the inStream so far
+    size_t _delivered = 0;
 public:
     inline NetworkInterface() {};
     inline NetworkInterface(interfaceId pubId) : _publicId(pubId) {};
@@ -35,33 +146,89 @@ public:
     // getters
     inline interfaceId publicId()   const { return _publicId; }
     inline interfaceId internalId() const { return _internalId; }
-    inline std::set<interfaceId> neighbors() const {return _neighbors; }
+    inline NeighborView neighbors() const {
+        if (_implicitNeighbors != nullptr) return NeighborView(_implicitNeighbors, _internalId);
+        return NeighborView(_neighborsBegin, _neighborsEnd);
+    }
+    inline bool isNeighbor(interfaceId nbr) const {
+        if (_implicitNeighbors != nullptr) return _implicitNeighbors->indexOf(_internalId, nbr) >= 0;
+        return std::binary_search(_neighborsBegin, _neighborsEnd, nbr);
+    }
+    // false once the neighbors were changed and copied out of the network
+    inline bool usesNetworkNeighbors() const { return _sharedNeighbors; }
     inline void setPublicId(interfaceId pid) { _publicId = pid; }
-    inline void addNeighbor(interfaceId nbr) {_neighbors.insert(nbr);};
-    inline void removeNeighbor(interfaceId nbr) {_neighbors.erase(nbr);};
+    inline void addNeighbor(interfaceId nbr) {
+        copyOnWriteNeighbors();
+        // topologies mostly add in ascending order
+        if (_ownNeighbors.empty() || _ownNeighbors.back() < nbr) {
+            _ownNeighbors.push_back(nbr);
+        } else {
+            auto it = std::lower_bound(_ownNeighbors.begin(), _ownNeighbors.end(), nbr);
+            if (it != _ownNeighbors.end() && *it == nbr) return;
+            _ownNeighbors.insert(it, nbr);
+        }
+        pointAtOwnNeighbors();
+    };
+    inline void removeNeighbor(interfaceId nbr) {
+        if (!isNeighbor(nbr)) return;
+        copyOnWriteNeighbors();
+        _ownNeighbors.erase(std::lower_bound(_ownNeighbors.begin(), _ownNeighbors.end(), nbr));
+        pointAtOwnNeighbors();
+    };
+    // Makes [first, last) (sorted, owned by the network and outliving this
+    // interface's use of it) the neighbors, dropping the private copy
+    inline void useSharedNeighbors(const interfaceId* first, const interfaceId* last) {
+        std::vector<interfaceId>().swap(_ownNeighbors);
+        _neighborsBegin = first;
+        _neighborsEnd = last;
+        _implicitNeighbors = nullptr;
+        _sharedNeighbors = true;
+    }
+    // Makes the neighbors of this interface's internal id in topology (owned by
+    // the network) the neighbors, dropping the private copy
+    inline void useImplicitNeighbors(const ImplicitTopology* topology) {
+        std::vector<interfaceId>().swap(_ownNeighbors);
+        _neighborsBegin = _neighborsEnd = nullptr;
+        _implicitNeighbors = topology;
+        _sharedNeighbors = true;
+    }
 
     // Send messages to to others using these
     virtual void unicastTo (json msg, const interfaceId& dest) = 0;
+    // Send a message body that is shared with other recipients; it must not be modified
+    virtual void unicastSharedTo (const SharedMessage& msg, const interfaceId& dest);
     virtual void unicast (json msg);
     virtual void multicast (json msg, const std::set<interfaceId>& targets);
     virtual void broadcast (json msg);
     virtual void broadcastBut (json msg, const interfaceId& id);
     virtual void randomMulticast (json msg);
 
+    // Send typed payloads (see Message.hpp). Interfaces that can not carry them
+    // natively fall back to the registered json conversion.
+    virtual void unicastPayloadTo (const Payload& msg, const interfaceId& dest);
+    virtual void multicastPayload (const Payload& msg, const std::set<interfaceId>& targets);
+    virtual void broadcastPayload (const Payload& msg);
+
     // Pop from local arrived inStream
     inline Packet popInStream();
-    inline bool inStreamEmpty() {
-        std::lock_guard<std::mutex> lock(_inStream_mtx);
-        return _inStream.empty(); 
-    }
+    inline bool inStreamEmpty() const { return _inStream.empty(); }
+
+    // Hand every arrived packet to handle(Packet&&), oldest first. Returns the number handled.
+    template<typename F>
+    inline size_t drainInStream(F&& handle) { return _inStream.drain(std::forward<F>(handle)); }
 
     // moves msgs to the inStream if they've arrived
     virtual void receive() = 0;
+    size_t deliveredPackets() const { return _delivered; }
+
+    // Earliest round in which receive() or the owner has packets to handle.
+    // Interfaces that cannot tell (e.g. real sockets) are busy every round.
+    virtual size_t nextEventRound() const { return RoundManager::currentRound() + 1; }
 
     // Clear everything
     virtual void clearAll() {
         _inStream.clear();
-        _neighbors.clear();
+        clearNeighbors();
     };
 };
 
@@ -71,26 +238,37 @@ public:
 
 // Unicast to the *first* neighbor (if any exist)
 inline void NetworkInterface::unicast(json msg) {
-    if (!_neighbors.empty()) {
-        auto firstNbr = *_neighbors.begin();
-        unicastTo(msg, firstNbr);
+    NeighborView nbrs = neighbors();
+    if (!nbrs.empty()) {
+        auto firstNbr = *nbrs.begin();
+        unicastTo(std::move(msg), firstNbr);
     }
 }
 
+inline void NetworkInterface::unicastSharedTo(const SharedMessage& msg, const interfaceId& dest) {
+    unicastTo(*msg, dest);
+}
+
+// The message is built once and shared by all recipients
 inline void NetworkInterface::multicast(json msg, const std::set<interfaceId>& targets) {
+    auto body = makeSharedMessage(std::move(msg));
     for (auto nbr : targets) {
-        unicastTo(msg, nbr);
+        unicastSharedTo(body, nbr);
     }
 }
 
 inline void NetworkInterface::broadcast(json msg) {
-    multicast(msg, _neighbors);
+    auto body = makeSharedMessage(std::move(msg));
+    for (auto nbr : neighbors()) {
+        unicastSharedTo(body, nbr);
+    }
 }
 
 inline void NetworkInterface::broadcastBut(json msg, const interfaceId& exceptId) {
-    for (auto nbr : _neighbors) {
+    auto body = makeSharedMessage(std::move(msg));
+    for (auto nbr : neighbors()) {
         if (nbr == exceptId) continue;
-        unicastTo(msg, nbr);
+        unicastSharedTo(body, nbr);
     }
 }
 
@@ -98,22 +276,35 @@ inline void NetworkInterface::broadcastBut(json msg, const interfaceId& exceptId
 inline void NetworkInterface::randomMulticast(json msg) {
 
     // pick a random subset size from 0..neighbors.size()
-    int count = uniformInt(0, (int)_neighbors.size());
+    int count = uniformInt(0, (int)neighbors().size());
 
-    std::vector<interfaceId> temp(_neighbors.begin(), _neighbors.end());  // Copy set to vector
+    NeighborView nbrs = neighbors();
+    std::vector<interfaceId> temp(nbrs.begin(), nbrs.end());  // Copy neighbors to vector
     std::shuffle(temp.begin(), temp.end(), threadLocalEngine());  // Shuffle vector
     std::set<interfaceId> subset(temp.begin(), temp.begin() + count);  // Take the first 'count' elements
 
-    multicast(msg, subset);
+    multicast(std::move(msg), subset);
 }
 
-inline Packet NetworkInterface::popInStream() {
-    std::lock_guard<std::mutex> lock(_inStream_mtx);
-    if (_inStream.empty()) {
-        return Packet();
+inline void NetworkInterface::unicastPayloadTo(const Payload& msg, const interfaceId& dest) {
+    unicastTo(msg.toJson(), dest);
+}
+
+inline void NetworkInterface::multicastPayload(const Payload& msg, const std::set<interfaceId>& targets) {
+    for (auto nbr : targets) {
+        unicastPayloadTo(msg, nbr);
+    }
+}
+
+inline void NetworkInterface::broadcastPayload(const Payload& msg) {
+    for (auto nbr : neighbors()) {
+        unicastPayloadTo(msg, nbr);
     }
-    Packet p = std::move(_inStream.front());
-    _inStream.pop_front();
+}
+
+inline Packet NetworkInterface::popInStream() {
+    Packet p;
+    _inStream.pop(p);
     return p;
 }
 } // end namespace quantas
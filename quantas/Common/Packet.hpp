@@ -17,11 +17,14 @@ You should have received a copy of the GNU General Public License along with QUA
 #ifndef Packet_hpp
 #define Packet_hpp
 
+#include <atomic>
 #include <iostream>
 #include <memory>
 #include "RoundManager.hpp"
 #include "RandomUtil.hpp"
 #include "Json.hpp"
+#include "Message.hpp"
+#include "BlockPool.hpp"
 
 namespace quantas{
     
@@ -33,59 +36,114 @@ typedef long interfaceId;
 
 inline static const interfaceId NO_PEER_ID = -1;  // used to indicate invalid peer or un init peers
 
+// A message body shared read-only by every packet it is sent in. Only
+// makeSharedMessage creates one, so the last packet holding it may move the
+// body out (see Packet::takeMessage).
+class SharedMessage {
+public:
+    SharedMessage() = default;
+    const json& operator*() const { return *_body; }
+    const json* operator->() const { return _body.get(); }
+    explicit operator bool() const { return static_cast<bool>(_body); }
+
+private:
+    explicit SharedMessage(std::shared_ptr<json> body) : _body(std::move(body)) {}
+    friend SharedMessage makeSharedMessage(json msg);
+    friend class Packet;
+
+    std::shared_ptr<json> _body;
+};
+
+// Allocates a message body that may be shared by many packets (from the
+// calling thread's block pool rather than the global heap)
+inline SharedMessage makeSharedMessage(json msg) {
+    return SharedMessage(std::allocate_shared<json>(PoolAllocator<json>(), std::move(msg)));
+}
+
 // Packet Class
 class Packet {
 private:
     interfaceId _targetId{NO_PEER_ID};  // Target node ID
     interfaceId _sourceId{NO_PEER_ID};  // Source node ID
-    json _body;                         // Message payload
+    SharedMessage _body;                // Message payload, immutable and shared by every copy of the packet
+    Payload _payload;                   // Typed message payload (pooled, shared like _body), used instead of _body when set
     int _delay{0};                      // Transmission delay
     int _round{-1};                     // Round message was sent
 
 public:
     inline Packet();
     inline Packet(interfaceId to, interfaceId from, json body);
-    inline Packet(const Packet& rhs);
-    inline Packet& operator=(const Packet& rhs);
+    Packet(const Packet& rhs) = default;
+    Packet(Packet&& rhs) noexcept = default;
+    Packet& operator=(const Packet& rhs) = default;
+    Packet& operator=(Packet&& rhs) noexcept = default;
     ~Packet() = default;
 
     // Setters
     inline void setSource(interfaceId s) { _sourceId = s; }
     inline void setTarget(interfaceId t) { _targetId = t; }
     inline void setDelay(int delayMax, int delayMin = 1);
-    inline void setMessage(json msg) { _body = msg; }
+    inline void setMessage(json msg) { setSharedMessage(makeSharedMessage(std::move(msg))); }
+    // msg is shared with other packets
+    inline void setSharedMessage(SharedMessage msg) { _body = std::move(msg); _payload = Payload(); }
+    inline void setPayload(const Payload& msg) { _payload = msg; _body = SharedMessage(); }
 
     // Getters
     inline interfaceId targetId() const { return _targetId; }
     inline interfaceId sourceId() const { return _sourceId; }
     inline bool hasArrived() const { return RoundManager::currentRound() >= _round + _delay; }
-    inline json getMessage() const { return _body; }
+    inline size_t arrivalRound() const { return _round + _delay; }
+    // json view of the message, converted from the typed payload if there is one.
+    // Returns a copy the caller may modify.
+    inline json getMessage() const { return _payload.empty() ? message() : _payload.toJson(); }
+    // Read-only json body without copying it (empty for typed payloads)
+    inline const json& message() const;
+    // Moves the json body out if no other packet shares it (copies otherwise);
+    // the packet is left without a message
+    inline json takeMessage();
+    inline bool hasPayload() const { return !_payload.empty(); }
+    inline const Payload& getPayload() const { return _payload; }
     inline int getDelay() const { return _delay; }
     inline int getRoundSent() const { return _round; }
 };
 
+// packets are copied in and out of every channel queue; keep them to the two
+// ids, two handles and the two ints
+static_assert(sizeof(Packet) <= 48, "Packet grew past 48 bytes");
+
 // Constructor Implementations
 inline Packet::Packet() {
     _round = RoundManager::currentRound();
 }
 
 inline Packet::Packet(interfaceId to, interfaceId from, json body)
-    : _targetId(to), _sourceId(from), _body(body), _delay(0) {
+    : _targetId(to), _sourceId(from), _body(makeSharedMessage(std::move(body))), _delay(0) {
     _round = RoundManager::currentRound();
 }
 
-inline Packet::Packet(const Packet& rhs) 
-    : _targetId(rhs._targetId), _sourceId(rhs._sourceId), _body(rhs._body), _delay(rhs._delay), _round(rhs._round) {
+inline const json& Packet::message() const {
+    static const json empty;
+    return _body ? *_body : empty;
 }
 
-inline Packet& Packet::operator=(const Packet& rhs) {
-    if (this == &rhs) return *this;
-    _targetId = rhs._targetId;
-    _sourceId = rhs._sourceId;
-    _delay = rhs._delay;
-    _round = rhs._round;
-    _body = rhs._body;
-    return *this;
+inline json Packet::takeMessage() {
+    if (!_payload.empty()) {
+        json msg = _payload.toJson();
+        _payload = Payload();
+        return msg;
+    }
+    if (!_body) return json();
+    json msg;
+    if (_body._body.use_count() == 1) {
+        // use_count is a relaxed load; packets that shared the body may have
+        // been dropped on other threads, and their reads must come before the move
+        std::atomic_thread_fence(std::memory_order_acquire);
+        msg = std::move(*_body._body);
+    } else {
+        msg = *_body;
+    }
+    _body = SharedMessage();
+    return msg;
 }
 
 inline void Packet::setDelay(int maxDelay, int minDelay) {
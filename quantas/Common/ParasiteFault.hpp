@@ -61,10 +61,9 @@ public:
 
         json privateMsg = msg;
         privateMsg["parasite_private"] = true;
-        for (auto collaborator : _collaborators) {
-            if (collaborator == peer->publicId()) continue;
-            peer->getNetworkInterface()->unicastTo(privateMsg, collaborator);
-        }
+        std::set<interfaceId> others = _collaborators;
+        others.erase(peer->publicId());
+        peer->getNetworkInterface()->multicast(std::move(privateMsg), others);
 
         tryRelease(peer);
         return true; // suppress public broadcast for now
@@ -108,6 +108,20 @@ inline Peer() {}
 
     // Called after performComputation in each round (subclass can override to collect metrics, etc.)
     virtual void endOfRound(std::vector<Peer*>& peers) {}
+
+    // Earliest round in which this peer has work that is not triggered by an
+    // arriving packet (timers, random submissions, mining, ...). Used when the
+    // simulation skips idle rounds; by default a peer is busy every round.
+    virtual size_t nextWakeRound() const { return RoundManager::currentRound() + 1; }
+
+    // Override to return true if endOfRound does nothing before the last round,
+    // otherwise the simulation can not skip idle rounds for this peer type.
+    virtual bool idleEndOfRound() const { return false; }
+
+    // Earliest of the peer's own wake up and its next packet arrival
+    size_t nextEventRound() const {
+        return std::min(nextWakeRound(), _networkInterface->nextEventRound());
+    }
     
     bool isCrashed() {return (_crashRecoveryRound > RoundManager::currentRound());}
     void setCrashRecoveryRound(size_t crashRecoveryRound) {_crashRecoveryRound = crashRecoveryRound;}
@@ -118,25 +132,34 @@ inline Peer() {}
     NetworkInterface* getNetworkInterface() const { return _networkInterface; };
     interfaceId publicId()   const { return _networkInterface->publicId(); };
     interfaceId internalId() const { return _networkInterface->internalId(); };
-    std::set<interfaceId> neighbors() const { return _networkInterface->neighbors(); };
+    NeighborView neighbors() const { return _networkInterface->neighbors(); };
     void setPublicId(interfaceId pid) { _networkInterface->setPublicId(pid); };
     void addNeighbor(interfaceId nbr) { _networkInterface->addNeighbor(nbr); };
     void removeNeighbor(interfaceId nbr) { _networkInterface->removeNeighbor(nbr); };
 
     // Send messages to to others using these
-    virtual void unicastTo (json msg, const interfaceId& dest) { _networkInterface->unicastTo(msg, dest); };
-    virtual void unicast (json msg) { _networkInterface->unicast(msg); };
-    virtual void multicast (json msg, const std::set<interfaceId>& targets) { _networkInterface->multicast(msg, targets); };
-    virtual void broadcast (json msg) { _networkInterface->broadcast(msg); };
-    virtual void broadcastBut (json msg, const interfaceId& id) { _networkInterface->broadcastBut(msg, id); };
-    virtual void randomMulticast (json msg) { _networkInterface->randomMulticast(msg); };
+    virtual void unicastTo (json msg, const interfaceId& dest) { _networkInterface->unicastTo(std::move(msg), dest); };
+    virtual void unicast (json msg) { _networkInterface->unicast(std::move(msg)); };
+    virtual void multicast (json msg, const std::set<interfaceId>& targets) { _networkInterface->multicast(std::move(msg), targets); };
+    virtual void broadcast (json msg) { _networkInterface->broadcast(std::move(msg)); };
+    virtual void broadcastBut (json msg, const interfaceId& id) { _networkInterface->broadcastBut(std::move(msg), id); };
+    virtual void randomMulticast (json msg) { _networkInterface->randomMulticast(std::move(msg)); };
+
+    // Typed messages (see Message.hpp), which skip building json on the hot path
+    virtual void unicastPayloadTo (const Payload& msg, const interfaceId& dest) { _networkInterface->unicastPayloadTo(msg, dest); };
+    virtual void multicastPayload (const Payload& msg, const std::set<interfaceId>& targets) { _networkInterface->multicastPayload(msg, targets); };
+    virtual void broadcastPayload (const Payload& msg) { _networkInterface->broadcastPayload(msg); };
 
     // Pop from local arrived inStream
     Packet popInStream() { return _networkInterface->popInStream(); };
     bool inStreamEmpty() const { return _networkInterface->inStreamEmpty(); }
+    // Hand every arrived packet to handle(Packet&&) in one call
+    template<typename F>
+    size_t drainInStream(F&& handle) { return _networkInterface->drainInStream(std::forward<F>(handle)); }
 
     // moves msgs to the inStream if they've arrived
     void receive() { _networkInterface->receive(); };
+    size_t deliveredPackets() const { return _networkInterface->deliveredPackets(); }
 
     // Clear everything
     void clearAll() { _networkInterface->clearAll(); };
@@ -0,0 +1,339 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Random undirected topologies, generated in time linear in the edges:
+//
+//   erdosRenyi      every pair linked with "probability" (or a mean "degree"),
+//                   drawn by geometric skips over the pairs of each peer
+//   barabasiAlbert  peer i links to "edgesPerPeer" earlier peers picked in
+//                   proportion to their degree; each edge's endpoint is found
+//                   from its own draws (Sanders and Schulz, "Scalable
+//                   generation of scale-free graphs"), so edges are
+//                   independent of each other
+//   wattsStrogatz   ring lattice of even "degree", each edge rewired to a
+//                   random peer with probability "rewiring"
+//   randomRegular   every peer has "degree" neighbors: a random pairing of
+//                   degree stubs per peer, with loops and repeated edges
+//                   switched away
+//
+// Every draw comes from a RandomStream keyed by the seed and the peer or edge
+// it decides, so a graph depends on the seed only, not on the threads that
+// build it. Loops and repeated edges are dropped (erdosRenyi has none,
+// barabasiAlbert and wattsStrogatz may leave a peer a few edges short).
+
+#ifndef RANDOM_TOPOLOGY_HPP
+#define RANDOM_TOPOLOGY_HPP
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include "Json.hpp"
+#include "Packet.hpp"
+#include "RandomUtil.hpp"
+
+namespace quantas {
+
+using nlohmann::json;
+
+class RandomTopology {
+public:
+    // true if type (a topology "type") is generated here
+    static bool supports(const std::string& type) {
+        return type == "erdosRenyi" || type == "barabasiAlbert" || type == "wattsStrogatz" || type == "randomRegular";
+    }
+
+    // draws come from the streams (seed, peer or edge, 0, phase)
+    RandomTopology(uint64_t seed, uint32_t phase) : _seed(seed), _phase(phase) {}
+
+    // Fills the neighbors of peers peers (indices, ascending and without
+    // repeats) as compressed sparse rows: peer i's are
+    // targets[firstOut[i] .. firstOut[i + 1]). parallel(count, body) runs
+    // body(begin, end) over [0, count), on as many threads as it likes.
+    // Throws std::invalid_argument on missing or impossible parameters.
+    template<typename Parallel>
+    void generate(const json& topology, int peers, std::vector<size_t>& firstOut,
+                  std::vector<interfaceId>& targets, Parallel&& parallel) const {
+        std::string type = topology.value("type", "");
+        if (peers < 0) throw std::invalid_argument(type + ": negative initialPeers");
+        if (type == "randomRegular") {
+            randomRegular(peers, topology.value("degree", 0), firstOut, targets, parallel);
+            return;
+        }
+        std::vector<Edge> edges;
+        if (type == "erdosRenyi") {
+            double p = topology.contains("probability") ? topology["probability"].get<double>()
+                     : peers > 1 ? topology.value("degree", 0.0) / (peers - 1) : 0.0;
+            erdosRenyi(peers, p, edges, parallel);
+        } else if (type == "barabasiAlbert") {
+            barabasiAlbert(peers, topology.value("edgesPerPeer", 0), edges, parallel);
+        } else if (type == "wattsStrogatz") {
+            wattsStrogatz(peers, topology.value("degree", 0), topology.value("rewiring", 0.0), edges, parallel);
+        } else {
+            throw std::invalid_argument("unknown random topology '" + type + "'");
+        }
+        symmetrize(peers, edges, firstOut, targets, parallel);
+    }
+
+private:
+    struct Edge { int32_t from, to; };
+
+    RandomStream stream(uint32_t index) const { return RandomStream(_seed, index, 0, _phase); }
+
+    // an edge count that fits the 32-bit indices used here
+    static size_t checkedEdges(const std::string& type, double edges) {
+        if (edges > double(INT32_MAX)) {
+            throw std::invalid_argument(type + ": too many edges (" + std::to_string(edges) + ")");
+        }
+        return static_cast<size_t>(edges);
+    }
+
+    // pairs (i, j), i < j, each with probability p: peer i skips ahead a
+    // geometric number of peers at a time, once to count and once to fill
+    template<typename Parallel>
+    void erdosRenyi(int peers, double p, std::vector<Edge>& edges, Parallel& parallel) const {
+        if (!(p >= 0.0 && p <= 1.0)) throw std::invalid_argument("erdosRenyi: probability must be in [0, 1]");
+        std::vector<size_t> first(peers + 1, 0);
+        double logMiss = std::log1p(-p);
+        auto forEach = [&](int i, auto&& emit) {
+            if (p <= 0.0) return;
+            if (p >= 1.0) {
+                for (int j = i + 1; j < peers; ++j) emit(j);
+                return;
+            }
+            RandomStream draws = stream(static_cast<uint32_t>(i));
+            double j = i;
+            while (true) {
+                // log of a uniform in (0, 1] over log(1 - p): pairs skipped
+                j += 1.0 + std::floor(std::log1p(-draws.nextDouble()) / logMiss);
+                if (j >= peers) break;
+                emit(static_cast<int32_t>(j));
+            }
+        };
+        parallel(peers, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                size_t count = 0;
+                forEach(i, [&](int32_t) { ++count; });
+                first[i + 1] = count;
+            }
+        });
+        for (int i = 0; i < peers; ++i) first[i + 1] += first[i];
+        edges.resize(checkedEdges("erdosRenyi", double(first[peers])));
+        parallel(peers, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                Edge* out = edges.data() + first[i];
+                forEach(i, [&](int32_t j) { *out++ = Edge{i, j}; });
+            }
+        });
+    }
+
+    // Edge e leaves peer e / m. With every edge's two ends laid out as
+    // (source 0, target 0, source 1, target 1, ...), its target is the peer at
+    // a uniform position before its own target: an even position is a source,
+    // known at once, an odd one the target of an earlier edge, found the same
+    // way (two steps on average).
+    template<typename Parallel>
+    void barabasiAlbert(int peers, int m, std::vector<Edge>& edges, Parallel& parallel) const {
+        if (m < 1) throw std::invalid_argument("barabasiAlbert: edgesPerPeer must be at least 1");
+        size_t count = checkedEdges("barabasiAlbert", double(peers) * m * 2) / 2;
+        edges.resize(count);
+        parallel(peers, [&](int begin, int end) {
+            for (size_t e = size_t(begin) * m; e < size_t(end) * m; ++e) {
+                uint32_t position = stream(static_cast<uint32_t>(e)).nextBelow(static_cast<uint32_t>(2 * e + 1));
+                while (position % 2 == 1) {
+                    uint32_t earlier = position / 2;
+                    position = stream(earlier).nextBelow(2 * earlier + 1);
+                }
+                edges[e] = Edge{static_cast<int32_t>(e / m), static_cast<int32_t>(position / 2 / m)};
+            }
+        });
+    }
+
+    // peer i links to i + 1 .. i + degree / 2, each link moved to a uniform
+    // other peer with probability rewiring
+    template<typename Parallel>
+    void wattsStrogatz(int peers, int degree, double rewiring, std::vector<Edge>& edges, Parallel& parallel) const {
+        if (degree < 2 || degree % 2 != 0 || degree >= peers) {
+            throw std::invalid_argument("wattsStrogatz: degree must be even, at least 2 and below initialPeers");
+        }
+        if (!(rewiring >= 0.0 && rewiring <= 1.0)) throw std::invalid_argument("wattsStrogatz: rewiring must be in [0, 1]");
+        const int half = degree / 2;
+        edges.resize(checkedEdges("wattsStrogatz", double(peers) * half));
+        parallel(peers, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                RandomStream draws = stream(static_cast<uint32_t>(i));
+                for (int j = 1; j <= half; ++j) {
+                    int32_t target = (i + j) % peers;
+                    if (draws.nextDouble() < rewiring) {
+                        target = static_cast<int32_t>(draws.nextBelow(static_cast<uint32_t>(peers - 1)));
+                        if (target >= i) ++target;
+                    }
+                    edges[size_t(i) * half + j - 1] = Edge{i, target};
+                }
+            }
+        });
+    }
+
+    // Configuration model: degree stubs per peer, shuffled and paired up.
+    // The few loops and repeated pairs (about degree^2 / 4, whatever the
+    // number of peers) are each switched with a random good pair: (a, b) and
+    // (c, d) become (a, c) and (b, d) when neither exists yet.
+    template<typename Parallel>
+    void randomRegular(int peers, int degree, std::vector<size_t>& firstOut,
+                       std::vector<interfaceId>& targets, Parallel& parallel) const {
+        if (degree < 1 || degree >= peers || (size_t(peers) * degree) % 2 != 0) {
+            throw std::invalid_argument("randomRegular: degree must be at least 1, below initialPeers, "
+                                        "and degree * initialPeers even");
+        }
+        const size_t stubs = checkedEdges("randomRegular", double(peers) * degree);
+        std::vector<int32_t> peerAt(stubs);   // the peer at each stub, stubs 2k and 2k + 1 are paired
+        parallel(peers, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) std::fill_n(peerAt.begin() + size_t(i) * degree, degree, i);
+        });
+        RandomStream draws = stream(0);
+        for (size_t k = stubs - 1; k > 0; --k) {
+            std::swap(peerAt[k], peerAt[draws.nextBelow(static_cast<uint32_t>(k + 1))]);
+        }
+        // the stubs of each peer
+        std::vector<uint32_t> stubsOf(stubs);
+        {
+            std::vector<uint32_t> next(peers);
+            for (int i = 0; i < peers; ++i) next[i] = static_cast<uint32_t>(size_t(i) * degree);
+            for (size_t k = 0; k < stubs; ++k) stubsOf[next[peerAt[k]]++] = static_cast<uint32_t>(k);
+        }
+        auto row = [&](int32_t peer) { return stubsOf.begin() + size_t(peer) * degree; };
+        // a pair of (a, b) other than skip and skipToo
+        auto linked = [&](int32_t a, int32_t b, size_t skip, size_t skipToo) {
+            for (auto it = row(a); it != row(a) + degree; ++it) {
+                size_t pair = *it / 2;
+                if (pair != skip && pair != skipToo && peerAt[*it ^ 1] == b) return true;
+            }
+            return false;
+        };
+        // a loop, or a pair that repeats an earlier one
+        const size_t pairs = stubs / 2;
+        std::vector<char> bad(pairs, 0);
+        parallel(static_cast<int>(pairs), [&](int begin, int end) {
+            for (size_t pair = begin; pair < size_t(end); ++pair) {
+                int32_t a = peerAt[2 * pair], b = peerAt[2 * pair + 1];
+                bool repeat = a == b;
+                for (auto it = row(a); !repeat && it != row(a) + degree; ++it) {
+                    repeat = *it / 2 < pair && peerAt[*it ^ 1] == b;
+                }
+                bad[pair] = repeat;
+            }
+        });
+        for (size_t pair = 0; pair < pairs; ++pair) {
+            if (!bad[pair]) continue;
+            for (size_t attempt = 0; ; ++attempt) {
+                if (attempt > 1000 * pairs) throw std::invalid_argument("randomRegular: no simple graph found");
+                size_t other = draws.nextBelow(static_cast<uint32_t>(pairs));
+                if (bad[other]) continue;
+                uint32_t sa = static_cast<uint32_t>(2 * pair), sb = sa + 1;
+                uint32_t sc = static_cast<uint32_t>(2 * other + draws.nextBelow(2)), sd = sc ^ 1;
+                int32_t a = peerAt[sa], b = peerAt[sb], c = peerAt[sc], d = peerAt[sd];
+                if (a == c || b == d || (a == d && b == c)) continue;
+                if (linked(a, c, pair, other) || linked(b, d, pair, other)) continue;
+                // b and c trade stubs
+                std::swap(peerAt[sb], peerAt[sc]);
+                *std::find(row(b), row(b) + degree, sb) = sc;
+                *std::find(row(c), row(c) + degree, sc) = sb;
+                break;
+            }
+            bad[pair] = 0;
+        }
+        firstOut.resize(size_t(peers) + 1);
+        targets.resize(stubs);
+        parallel(peers, [&](int begin, int end) {
+            for (int i = begin; i < end; ++i) {
+                firstOut[i + 1] = size_t(i + 1) * degree;
+                auto out = targets.begin() + size_t(i) * degree;
+                for (int k = 0; k < degree; ++k) out[k] = peerAt[row(i)[k] ^ 1];
+                std::sort(out, out + degree);
+            }
+        });
+        firstOut[0] = 0;
+    }
+
+    // Both directions of every edge, as sorted rows without loops or repeats.
+    // Each direction first goes to the bucket of 2^BUCKET_BITS peers its
+    // source is in and then, a bucket at a time, to its row, which keeps the
+    // writes within a small range of memory instead of all over it. Entries
+    // land in whatever order the threads get to them and rows are sorted
+    // afterwards, so the result does not depend on the threads.
+    static constexpr int BUCKET_BITS = 12;
+
+    template<typename Parallel>
+    static void symmetrize(int peers, const std::vector<Edge>& edges, std::vector<size_t>& firstOut,
+                           std::vector<interfaceId>& targets, Parallel& parallel) {
+        const int count = static_cast<int>(edges.size());
+        std::vector<std::atomic<uint32_t>> degree(peers);
+        parallel(count, [&](int begin, int end) {
+            for (int k = begin; k < end; ++k) {
+                if (edges[k].from == edges[k].to) continue;
+                degree[edges[k].from].fetch_add(1, std::memory_order_relaxed);
+                degree[edges[k].to].fetch_add(1, std::memory_order_relaxed);
+            }
+        });
+        std::vector<size_t> first(size_t(peers) + 1, 0);
+        for (int i = 0; i < peers; ++i) first[i + 1] = first[i] + degree[i].load(std::memory_order_relaxed);
+        std::vector<std::atomic<uint32_t>>().swap(degree);
+
+        const int buckets = (peers >> BUCKET_BITS) + 1;
+        auto bucketStart = [&](int b) { return first[std::min(peers, b << BUCKET_BITS)]; };
+        std::vector<std::atomic<size_t>> cursor(buckets);
+        for (int b = 0; b < buckets; ++b) cursor[b].store(bucketStart(b), std::memory_order_relaxed);
+        std::vector<Edge> directed(first[peers]);
+        parallel(count, [&](int begin, int end) {
+            for (int k = begin; k < end; ++k) {
+                const Edge& e = edges[k];
+                if (e.from == e.to) continue;
+                directed[cursor[e.from >> BUCKET_BITS].fetch_add(1, std::memory_order_relaxed)] = e;
+                directed[cursor[e.to >> BUCKET_BITS].fetch_add(1, std::memory_order_relaxed)] = Edge{e.to, e.from};
+            }
+        });
+
+        std::vector<interfaceId> all(first[peers]);
+        std::vector<size_t> kept(size_t(peers) + 1, 0);
+        parallel(buckets, [&](int begin, int end) {
+            std::vector<size_t> next;
+            for (int b = begin; b < end; ++b) {
+                int low = std::min(peers, b << BUCKET_BITS), high = std::min(peers, (b + 1) << BUCKET_BITS);
+                next.assign(first.begin() + low, first.begin() + high);
+                for (size_t k = first[low]; k < first[high]; ++k) {
+                    all[next[directed[k].from - low]++] = directed[k].to;
+                }
+                for (int i = low; i < high; ++i) {
+                    auto row = all.begin() + first[i], rowEnd = all.begin() + first[i + 1];
+                    std::sort(row, rowEnd);
+                    kept[i + 1] = std::unique(row, rowEnd) - row;
+                }
+            }
+        });
+        std::vector<Edge>().swap(directed);
+        // close the gaps the repeats left, rows only move to the left
+        for (int i = 0; i < peers; ++i) {
+            kept[i + 1] += kept[i];
+            std::copy_n(all.begin() + first[i], kept[i + 1] - kept[i], all.begin() + kept[i]);
+        }
+        all.resize(kept[peers]);
+        targets.swap(all);
+        firstOut.swap(kept);
+    }
+
+    uint64_t _seed;
+    uint32_t _phase;
+};
+
+} // namespace quantas
+
+#endif /* RANDOM_TOPOLOGY_HPP */
@@ -1,6 +1,10 @@
 #ifndef RANDOM_UTIL_HPP
 #define RANDOM_UTIL_HPP
 
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
 #include <random>
 #include <thread>
 #include <ctime>
@@ -10,41 +14,148 @@
 namespace quantas {
 
 //
-// 1) A single thread_local function that gives us the engine
+// 1) Counter-based generator
 //
-inline std::mt19937& threadLocalEngine() {
-    // We combine the time and the hashed thread ID to get a seed unique to each thread
-    static thread_local std::mt19937 engine(
-        static_cast<unsigned>(std::time(nullptr))
-        + static_cast<unsigned>(std::hash<std::thread::id>{}(std::this_thread::get_id()))
+// Philox4x32-10 (Salmon et al., "Parallel Random Numbers: As Easy as 1, 2, 3").
+// Every block of four 32-bit draws is a pure function of a 128-bit counter and
+// a 64-bit key, so a stream can be positioned anywhere without stepping
+// through the draws before it, and streams with different keys or counters
+// are independent.
+//
+inline std::array<uint32_t, 4> philox4x32(std::array<uint32_t, 4> ctr, std::array<uint32_t, 2> key) {
+    for (int round = 0; round < 10; ++round) {
+        if (round > 0) {
+            key[0] += 0x9E3779B9u;
+            key[1] += 0xBB67AE85u;
+        }
+        uint64_t p0 = uint64_t(0xD2511F53u) * ctr[0];
+        uint64_t p1 = uint64_t(0xCD9E8D57u) * ctr[2];
+        ctr = {uint32_t(p1 >> 32) ^ ctr[1] ^ key[0], uint32_t(p1),
+               uint32_t(p0 >> 32) ^ ctr[3] ^ key[1], uint32_t(p0)};
+    }
+    return ctr;
+}
+
+// mixes a 64-bit value into a well distributed one (used to derive seeds)
+inline uint64_t splitMix64(uint64_t x) {
+    x += 0x9E3779B97F4A7C15ull;
+    x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+    x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+    return x ^ (x >> 31);
+}
+
+// The sequence of draws identified by (seed, stream, round, phase). The
+// simulation positions the calling thread's stream before every peer's
+// receive and computation (stream = the peer's index), so what a peer draws
+// does not depend on which thread runs it or on how many threads there are.
+// Satisfies UniformRandomBitGenerator, so it can drive std::shuffle and the
+// std distributions.
+class RandomStream {
+public:
+    typedef uint32_t result_type;
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return UINT32_MAX; }
+
+    RandomStream() = default;
+    RandomStream(uint64_t seed, uint32_t stream, uint32_t round = 0, uint32_t phase = 0) {
+        reseat(seed, stream, round, phase);
+    }
+
+    // start over at the first draw of the sequence (seed, stream, round, phase)
+    void reseat(uint64_t seed, uint32_t stream, uint32_t round, uint32_t phase) {
+        _key = {stream, static_cast<uint32_t>(seed)};
+        _counter = {0, phase, round, static_cast<uint32_t>(seed >> 32)};
+        _next = 4;
+    }
+
+    result_type operator()() {
+        if (_next == 4) refill();
+        return _block[_next++];
+    }
+
+    // the next n draws, the same words n calls to operator() would return
+    void fill(uint32_t* out, size_t n) {
+        while (n > 0 && _next < 4) { *out++ = _block[_next++]; --n; }
+        for (; n >= 4; n -= 4, out += 4) {
+            std::array<uint32_t, 4> block = philox4x32(_counter, _key);
+            ++_counter[0];
+            out[0] = block[0]; out[1] = block[1]; out[2] = block[2]; out[3] = block[3];
+        }
+        while (n > 0) { *out++ = (*this)(); --n; }
+    }
+
+    // uniform double in [0, 1) with 53 random bits
+    double nextDouble() {
+        uint64_t hi = (*this)();
+        uint64_t lo = (*this)();
+        return static_cast<double>(((hi << 32) | lo) >> 11) * 0x1.0p-53;
+    }
+
+    // uniform integer in [0, range), range > 0 (Lemire's multiply and reject)
+    uint32_t nextBelow(uint32_t range) {
+        uint64_t m = uint64_t((*this)()) * range;
+        uint32_t low = static_cast<uint32_t>(m);
+        if (low < range) {
+            uint32_t threshold = static_cast<uint32_t>(-range) % range;
+            while (low < threshold) {
+                m = uint64_t((*this)()) * range;
+                low = static_cast<uint32_t>(m);
+            }
+        }
+        return static_cast<uint32_t>(m >> 32);
+    }
+
+private:
+    void refill() {
+        _block = philox4x32(_counter, _key);
+        ++_counter[0];
+        _next = 0;
+    }
+
+    std::array<uint32_t, 2> _key{};
+    std::array<uint32_t, 4> _counter{};
+    std::array<uint32_t, 4> _block{};
+    unsigned _next{4};
+};
+
+//
+// 2) The calling thread's stream. Outside a simulation it is seeded from the
+//    time and the thread id, so every thread draws something different.
+//
+inline RandomStream& threadLocalEngine() {
+    static thread_local RandomStream engine(
+        splitMix64(static_cast<uint64_t>(std::time(nullptr))
+        ^ (static_cast<uint64_t>(std::hash<std::thread::id>{}(std::this_thread::get_id())) << 1)),
+        0
     );
     return engine;
 }
 
 //
-// 2) Uniform integer in [min, max]
+// 3) Uniform integer in [min, max]
 //
 inline int uniformInt(int minVal, int maxVal) {
     if (minVal > maxVal) {
         throw std::invalid_argument("uniformInt: minVal > maxVal");
     }
-    std::uniform_int_distribution<int> dist(minVal, maxVal);
-    return dist(threadLocalEngine());
+    uint64_t range = uint64_t(int64_t(maxVal) - int64_t(minVal)) + 1;
+    RandomStream& engine = threadLocalEngine();
+    uint32_t offset = range > UINT32_MAX ? engine() : engine.nextBelow(static_cast<uint32_t>(range));
+    return static_cast<int>(int64_t(minVal) + offset);
 }
 
 //
-// 3) Uniform real in [min, max)
+// 4) Uniform real in [min, max)
 //
 inline double uniformReal(double minVal, double maxVal) {
     if (minVal > maxVal) {
         throw std::invalid_argument("uniformReal: minVal > maxVal");
     }
-    std::uniform_real_distribution<double> dist(minVal, maxVal);
-    return dist(threadLocalEngine());
+    return minVal + (maxVal - minVal) * threadLocalEngine().nextDouble();
 }
 
 //
-// 4) randMod(exclusiveMax) -> returns integer in [0, exclusiveMax-1]
+// 5) randMod(exclusiveMax) -> returns integer in [0, exclusiveMax-1]
 //
 inline int randMod(int exclusiveMax) {
     if (exclusiveMax <= 0) {
@@ -57,7 +168,7 @@ inline int randMod(int exclusiveMax) {
 }
 
 //
-// 5) trueWithProbability(p) -> returns true with probability p
+// 6) trueWithProbability(p) -> returns true with probability p
 //
 inline bool trueWithProbability(double p) {
     if (p <= 0.0) {
@@ -65,7 +176,7 @@ inline bool trueWithProbability(double p) {
     } else if (p >= 1.0) {
         return true;
     } else {
-        return (uniformReal(0.0, 1.0) < p);
+        return (threadLocalEngine().nextDouble() < p);
     }
 }
 
@@ -75,10 +186,89 @@ inline int poissonInt(double lambda) {
             "poissonInt: mean (lambda) must be > 0, received: " + std::to_string(lambda)
         );
     }
-    std::poisson_distribution<int> dist(lambda);
-    return dist(threadLocalEngine());
+    RandomStream& engine = threadLocalEngine();
+    if (lambda >= 30.0) {
+        std::poisson_distribution<int> dist(lambda);
+        return dist(engine);
+    }
+    // Knuth's product of uniforms, cheap for the small means used for delays
+    double limit = std::exp(-lambda);
+    double product = engine.nextDouble();
+    int k = 0;
+    while (product > limit) {
+        product *= engine.nextDouble();
+        ++k;
+    }
+    return k;
+}
+
+//
+// 7) geometricInt(p) -> number of Bernoulli(p) trials up to and including the first success
+//
+inline int geometricInt(double p) {
+    if (p <= 0.0 || p > 1.0) {
+        throw std::invalid_argument(
+            "geometricInt: p must be in (0, 1], received: " + std::to_string(p)
+        );
+    }
+    if (p == 1.0) {
+        return 1;
+    }
+    // inversion, u in (0, 1]
+    double u = 1.0 - threadLocalEngine().nextDouble();
+    double trials = std::floor(std::log(u) / std::log1p(-p));
+    if (trials >= double(INT32_MAX - 1)) return INT32_MAX;
+    return static_cast<int>(trials) + 1;
+}
+
+//
+// 8) Batches: n draws into out, for callers that need many at once
+//
+// Draws the words in bulk and rejects them as RandomStream::nextBelow does,
+// a rejected word simply being followed by the next one. It never fetches
+// more words than draws are left, so the stream ends up where n calls to
+// uniformInt would leave it, with the same values.
+inline void fillUniformInt(int* out, size_t n, int minVal, int maxVal) {
+    if (minVal > maxVal) {
+        throw std::invalid_argument("fillUniformInt: minVal > maxVal");
+    }
+    const uint64_t range = uint64_t(int64_t(maxVal) - int64_t(minVal)) + 1;
+    // 2^32 mod range, words whose product leaves less are rejected
+    const uint32_t threshold = static_cast<uint32_t>((uint64_t(1) << 32) % range);
+    constexpr size_t CHUNK = 128;
+    uint32_t words[CHUNK];
+    RandomStream& engine = threadLocalEngine();
+    size_t done = 0;
+    while (done < n) {
+        size_t count = n - done < CHUNK ? n - done : CHUNK;
+        engine.fill(words, count);
+        for (size_t j = 0; j < count; ++j) {
+            uint64_t m = uint64_t(words[j]) * range;
+            out[done] = static_cast<int>(int64_t(minVal) + int64_t(m >> 32));
+            done += static_cast<uint32_t>(m) >= threshold;
+        }
+    }
+}
+
+inline void fillUniformReal(double* out, size_t n, double minVal, double maxVal) {
+    if (minVal > maxVal) {
+        throw std::invalid_argument("fillUniformReal: minVal > maxVal");
+    }
+    constexpr size_t CHUNK = 64;
+    uint32_t words[2 * CHUNK];
+    RandomStream& engine = threadLocalEngine();
+    while (n > 0) {
+        size_t count = n < CHUNK ? n : CHUNK;
+        engine.fill(words, 2 * count);
+        for (size_t i = 0; i < count; ++i) {
+            uint64_t bits = ((uint64_t(words[2 * i]) << 32) | words[2 * i + 1]) >> 11;
+            out[i] = minVal + (maxVal - minVal) * (static_cast<double>(bits) * 0x1.0p-53);
+        }
+        out += count;
+        n -= count;
+    }
 }
 
 } // namespace quantas
 
-#endif // RANDOM_UTIL_HPP
\ No newline at end of file
+#endif // RANDOM_UTIL_HPP
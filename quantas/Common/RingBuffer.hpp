@@ -0,0 +1,183 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// FIFO queue stored in one contiguous ring, used for channel and inStream
+// packet queues instead of std::deque. Nothing is allocated until the first
+// push; the ring doubles when full, up to an optional capacity bound (e.g. the
+// size of a channel), so a queue in steady state never touches the heap. An
+// owner that has drained the queue can hand the ring back with shrink_to_fit().
+
+#ifndef RING_BUFFER_HPP
+#define RING_BUFFER_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+namespace quantas {
+
+template<typename T>
+class RingBuffer {
+public:
+    template<bool Const>
+    class Iterator {
+    public:
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef typename std::conditional<Const, const T*, T*>::type pointer;
+        typedef typename std::conditional<Const, const T&, T&>::type reference;
+        typedef typename std::conditional<Const, const RingBuffer*, RingBuffer*>::type owner;
+
+        Iterator() = default;
+        Iterator(owner ring, size_t index) : _ring(ring), _index(index) {}
+
+        reference operator*() const { return (*_ring)[_index]; }
+        pointer operator->() const { return &(*_ring)[_index]; }
+        reference operator[](difference_type n) const { return (*_ring)[_index + n]; }
+
+        Iterator& operator++() { ++_index; return *this; }
+        Iterator operator++(int) { Iterator it = *this; ++_index; return it; }
+        Iterator& operator--() { --_index; return *this; }
+        Iterator operator--(int) { Iterator it = *this; --_index; return it; }
+        Iterator& operator+=(difference_type n) { _index += n; return *this; }
+        Iterator& operator-=(difference_type n) { _index -= n; return *this; }
+        Iterator operator+(difference_type n) const { return Iterator(_ring, _index + n); }
+        Iterator operator-(difference_type n) const { return Iterator(_ring, _index - n); }
+        friend Iterator operator+(difference_type n, const Iterator& it) { return it + n; }
+        difference_type operator-(const Iterator& rhs) const {
+            return static_cast<difference_type>(_index) - static_cast<difference_type>(rhs._index);
+        }
+
+        bool operator==(const Iterator& rhs) const { return _index == rhs._index; }
+        bool operator!=(const Iterator& rhs) const { return _index != rhs._index; }
+        bool operator<(const Iterator& rhs) const { return _index < rhs._index; }
+        bool operator>(const Iterator& rhs) const { return _index > rhs._index; }
+        bool operator<=(const Iterator& rhs) const { return _index <= rhs._index; }
+        bool operator>=(const Iterator& rhs) const { return _index >= rhs._index; }
+
+    private:
+        owner _ring{nullptr};
+        size_t _index{0};
+    };
+
+    typedef Iterator<false> iterator;
+    typedef Iterator<true> const_iterator;
+
+    RingBuffer() = default;
+    explicit RingBuffer(size_t maxCapacity) : _maxCapacity(std::max<size_t>(maxCapacity, 1)) {}
+    RingBuffer(const RingBuffer&) = delete;
+    RingBuffer& operator=(const RingBuffer&) = delete;
+    ~RingBuffer() {
+        clear();
+        release();
+    }
+
+    bool empty() const { return _size == 0; }
+    size_t size() const { return _size; }
+    size_t capacity() const { return _capacity; }
+
+    // bound the ring grows to (the queue may still be limited more tightly by its owner)
+    void setMaxCapacity(size_t maxCapacity) { _maxCapacity = std::max<size_t>(maxCapacity, 1); }
+
+    T& operator[](size_t i) { return _data[slot(i)]; }
+    const T& operator[](size_t i) const { return _data[slot(i)]; }
+    T& front() { return _data[_head]; }
+    const T& front() const { return _data[_head]; }
+    T& back() { return (*this)[_size - 1]; }
+    const T& back() const { return (*this)[_size - 1]; }
+
+    iterator begin() { return iterator(this, 0); }
+    iterator end() { return iterator(this, _size); }
+    const_iterator begin() const { return const_iterator(this, 0); }
+    const_iterator end() const { return const_iterator(this, _size); }
+
+    void push_back(const T& value) { emplace_back(value); }
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+
+    template<typename... Args>
+    T& emplace_back(Args&&... args) {
+        if (_size == _capacity) grow();
+        T* p = _data + slot(_size);
+        ::new (static_cast<void*>(p)) T(std::forward<Args>(args)...);
+        ++_size;
+        return *p;
+    }
+
+    void pop_front() {
+        _data[_head].~T();
+        if (++_head == _capacity) _head = 0;
+        if (--_size == 0) _head = 0;
+    }
+
+    void clear() {
+        while (_size > 0) pop_front();
+    }
+
+    // make room for at least n elements without growing later
+    void reserve(size_t n) {
+        if (n > _capacity) reallocate(n);
+    }
+
+    // free the ring of an empty queue that grew past its first allocation
+    // (a queue that only ever holds a few elements keeps its ring, so steady
+    // traffic does not allocate on every push); the next push allocates again
+    void shrink_to_fit() {
+        if (_size == 0 && _capacity > INITIAL_CAPACITY) release();
+    }
+
+private:
+    size_t slot(size_t i) const {
+        size_t s = _head + i;
+        return s >= _capacity ? s - _capacity : s;
+    }
+
+    void grow() {
+        size_t target = _capacity == 0 ? INITIAL_CAPACITY : _capacity * 2;
+        target = std::min(target, _maxCapacity);
+        if (target <= _capacity) target = _capacity + 1; // bound reached, only the owner can refuse more
+        reallocate(target);
+    }
+
+    void reallocate(size_t capacity) {
+        T* data = std::allocator<T>().allocate(capacity);
+        for (size_t i = 0; i < _size; ++i) {
+            T& src = (*this)[i];
+            ::new (static_cast<void*>(data + i)) T(std::move(src));
+            src.~T();
+        }
+        release();
+        _data = data;
+        _capacity = capacity;
+        _head = 0;
+    }
+
+    void release() {
+        if (_data) std::allocator<T>().deallocate(_data, _capacity);
+        _data = nullptr;
+        _capacity = 0;
+    }
+
+    static constexpr size_t INITIAL_CAPACITY = 8;
+
+    T* _data{nullptr};
+    size_t _capacity{0};
+    size_t _head{0};
+    size_t _size{0};
+    size_t _maxCapacity{SIZE_MAX};
+};
+
+} // namespace quantas
+
+#endif /* RING_BUFFER_HPP */
@@ -30,19 +30,35 @@ private:
     bool _synchronous{true};
     std::chrono::steady_clock::time_point _start_time;
 
-    // Private constructor and copy operations to enforce singleton usage:
+    // instance bound to the calling thread, see Scope
+    static inline thread_local RoundManager* t_bound = nullptr;
+
+public:
+    // Every simulation owns one; the static accessors below reach the one
+    // bound to the calling thread and fall back to a process wide instance.
     RoundManager() {
         _start_time = std::chrono::steady_clock::now();
     };
     RoundManager(const RoundManager&) = delete;
     RoundManager& operator=(const RoundManager&) = delete;
 
-public:
     static RoundManager* instance() {
+        if (t_bound != nullptr) return t_bound;
         static RoundManager s;
         return &s;
     }
 
+    // binds a RoundManager to the calling thread for the lifetime of the scope
+    class Scope {
+    public:
+        explicit Scope(RoundManager* bound) : _previous(t_bound) { t_bound = bound; }
+        ~Scope() { t_bound = _previous; }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+    private:
+        RoundManager* _previous;
+    };
+
     static size_t currentRound() { 
         RoundManager* inst = instance();
         if (inst->_synchronous) {
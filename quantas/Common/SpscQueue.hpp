@@ -0,0 +1,171 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Unbounded lock-free queue for exactly one producer thread and one consumer
+// thread, used for a network interface's inStream: receive() (or the concrete
+// listener thread) produces and the owning peer consumes.
+//
+// Packets are stored in a linked list of fixed-size segments. The producer only
+// writes the tail segment and publishes each element with a release store of
+// the segment's write count; the consumer only reads the head segment. A fully
+// read segment is kept as a spare for the producer instead of being freed.
+// Nothing is allocated before the first push, and release() gives the
+// segments of an emptied queue back.
+
+#ifndef SPSC_QUEUE_HPP
+#define SPSC_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <utility>
+
+namespace quantas {
+
+template<typename T, size_t SEGMENT_SIZE = 32>
+class SpscQueue {
+public:
+    SpscQueue() = default;
+    SpscQueue(const SpscQueue&) = delete;
+    SpscQueue& operator=(const SpscQueue&) = delete;
+    ~SpscQueue() {
+        clear();
+        release();
+    }
+
+    // producer side
+    void push_back(T&& value) { emplace_back(std::move(value)); }
+    void push_back(const T& value) { emplace_back(value); }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args) {
+        Segment* tail = _tail;
+        if (tail == nullptr) {
+            tail = _tail = newSegment();
+            _first.store(tail, std::memory_order_release);
+        }
+        size_t w = tail->written.load(std::memory_order_relaxed);
+        if (w == SEGMENT_SIZE) {
+            Segment* seg = newSegment();
+            tail->next.store(seg, std::memory_order_release);
+            tail = _tail = seg;
+            w = 0;
+        }
+        ::new (static_cast<void*>(tail->slot(w))) T(std::forward<Args>(args)...);
+        tail->written.store(w + 1, std::memory_order_release);
+    }
+
+    // consumer side
+    bool empty() const {
+        const Segment* seg = head();
+        if (seg == nullptr) return true;
+        if (seg->read < seg->written.load(std::memory_order_acquire)) return false;
+        if (seg->read < SEGMENT_SIZE) return true;
+        const Segment* next = seg->next.load(std::memory_order_acquire);
+        return next == nullptr || next->written.load(std::memory_order_acquire) == 0;
+    }
+
+    // move the oldest element into out; false if the queue is empty
+    bool pop(T& out) {
+        Segment* seg = advance();
+        if (seg == nullptr || seg->read == seg->written.load(std::memory_order_acquire)) return false;
+        T* p = seg->slot(seg->read);
+        out = std::move(*p);
+        p->~T();
+        ++seg->read;
+        return true;
+    }
+
+    // hand every element published so far to f, oldest first; returns how many
+    template<typename F>
+    size_t drain(F&& f) {
+        size_t count = 0;
+        for (Segment* seg = advance(); seg != nullptr; seg = advance()) {
+            size_t written = seg->written.load(std::memory_order_acquire);
+            if (seg->read == written) break;
+            for (; seg->read < written; ++seg->read, ++count) {
+                T* p = seg->slot(seg->read);
+                f(std::move(*p));
+                p->~T();
+            }
+        }
+        return count;
+    }
+
+    // not thread safe, neither side may be active
+    void clear() {
+        drain([](T&&) {});
+    }
+
+    // free the segments of an empty queue; the next push allocates again.
+    // Not thread safe, neither side may be active
+    void release() {
+        if (!empty()) return;
+        Segment* seg = head();
+        while (seg != nullptr) {
+            Segment* next = seg->next.load(std::memory_order_relaxed);
+            delete seg;
+            seg = next;
+        }
+        delete _spare.exchange(nullptr, std::memory_order_relaxed);
+        _head = _tail = nullptr;
+        _first.store(nullptr, std::memory_order_relaxed);
+    }
+
+private:
+    struct Segment {
+        std::atomic<size_t> written{0};      // set by the producer
+        std::atomic<Segment*> next{nullptr}; // set by the producer
+        size_t read{0};                      // consumer only
+        alignas(T) unsigned char storage[SEGMENT_SIZE * sizeof(T)];
+
+        T* slot(size_t i) { return reinterpret_cast<T*>(storage) + i; }
+    };
+
+    Segment* head() const {
+        return _head != nullptr ? _head : _first.load(std::memory_order_acquire);
+    }
+
+    // consumer: step past a fully read head segment once its successor exists
+    Segment* advance() {
+        if (_head == nullptr) {
+            _head = _first.load(std::memory_order_acquire);
+            if (_head == nullptr) return nullptr;
+        }
+        if (_head->read == SEGMENT_SIZE) {
+            Segment* next = _head->next.load(std::memory_order_acquire);
+            if (next == nullptr) return _head;
+            Segment* done = _head;
+            _head = next;
+            recycle(done);
+        }
+        return _head;
+    }
+
+    void recycle(Segment* seg) {
+        seg->read = 0;
+        seg->next.store(nullptr, std::memory_order_relaxed);
+        seg->written.store(0, std::memory_order_relaxed);
+        delete _spare.exchange(seg, std::memory_order_acq_rel);
+    }
+
+    Segment* newSegment() {
+        Segment* seg = _spare.exchange(nullptr, std::memory_order_acq_rel);
+        return seg != nullptr ? seg : new Segment();
+    }
+
+    Segment* _head{nullptr};                   // consumer
+    Segment* _tail{nullptr};                   // producer
+    std::atomic<Segment*> _first{nullptr};     // first segment, published by the producer
+    std::atomic<Segment*> _spare{nullptr};     // one recycled segment
+};
+
+} // namespace quantas
+
+#endif /* SPSC_QUEUE_HPP */
@@ -0,0 +1,228 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Binary topology file: the neighbors of every peer in compressed sparse rows,
+// optionally with an index per edge into the topology's "distributions". The
+// network maps the file and builds from the arrays in place, so a graph with
+// millions of edges is not parsed from JSON. Fields are in the byte order of
+// the machine that wrote the file (checked through the magic number).
+//
+//   header      magic "QTOP", version, flags (bit 0: properties follow),
+//               reserved (uint32 each), peers, edges (uint64 each)
+//   firstOut    peers + 1 uint64, peer i's neighbors are [firstOut[i], firstOut[i+1])
+//   targets     edges int32, each peer's neighbors ascending and without repeats
+//   properties  edges uint32 when flagged, the edge's entry in "distributions"
+//
+// write() produces a file and fromList() reads the "list" object of a userList
+// topology (see quantas/Tools/topologyConverter.cpp).
+
+#ifndef TOPOLOGY_FILE_HPP
+#define TOPOLOGY_FILE_HPP
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+#include "Json.hpp"
+
+#if defined(__unix__) || defined(__APPLE__)
+    #include <fcntl.h>
+    #include <sys/mman.h>
+    #include <sys/stat.h>
+    #include <unistd.h>
+    #define QUANTAS_MMAP 1
+#endif
+
+namespace quantas {
+
+using nlohmann::json;
+
+class TopologyFile {
+public:
+    static constexpr uint32_t VERSION = 1;
+    static constexpr uint32_t HAS_PROPERTIES = 1;
+
+    // Maps path and checks its layout; throws std::runtime_error if it is not
+    // a topology file
+    explicit TopologyFile(const std::string& path) : _path(path) {
+        map();
+        try {
+            check();
+        } catch (...) {
+            unmap();
+            throw;
+        }
+    }
+    ~TopologyFile() { unmap(); }
+    TopologyFile(const TopologyFile&) = delete;
+    TopologyFile& operator=(const TopologyFile&) = delete;
+
+    uint64_t peers() const { return header().peers; }
+    uint64_t edges() const { return header().edges; }
+    const uint64_t* firstOut() const { return reinterpret_cast<const uint64_t*>(_data + sizeof(Header)); }
+    const int32_t* targets() const { return reinterpret_cast<const int32_t*>(firstOut() + peers() + 1); }
+    // nullptr when the file has no per-edge properties
+    const uint32_t* properties() const {
+        if (!(header().flags & HAS_PROPERTIES)) return nullptr;
+        return reinterpret_cast<const uint32_t*>(targets() + edges());
+    }
+
+    // Writes a topology file; properties is empty or holds one entry per target
+    static void write(const std::string& path, const std::vector<uint64_t>& firstOut,
+                      const std::vector<int32_t>& targets, const std::vector<uint32_t>& properties) {
+        Header h;
+        std::memcpy(h.magic, MAGIC, sizeof(h.magic));
+        h.version = VERSION;
+        h.flags = properties.empty() ? 0 : HAS_PROPERTIES;
+        h.peers = firstOut.empty() ? 0 : firstOut.size() - 1;
+        h.edges = targets.size();
+        if (!properties.empty() && properties.size() != targets.size()) {
+            throw std::invalid_argument("TopologyFile: one property per edge expected");
+        }
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        if (!out) throw std::runtime_error("TopologyFile: cannot write " + path);
+        out.write(reinterpret_cast<const char*>(&h), sizeof(h));
+        out.write(reinterpret_cast<const char*>(firstOut.data()), firstOut.size() * sizeof(uint64_t));
+        out.write(reinterpret_cast<const char*>(targets.data()), targets.size() * sizeof(int32_t));
+        out.write(reinterpret_cast<const char*>(properties.data()), properties.size() * sizeof(uint32_t));
+        if (!out) throw std::runtime_error("TopologyFile: cannot write " + path);
+    }
+
+    // The rows of a userList "list" object ({"0": [1, 2], ...}) for peers
+    // peers: neighbors sorted and without repeats, as userList adds them. An
+    // entry is a neighbor index or [index, property]; properties stays empty
+    // unless some entry has one (the others then get property 0).
+    static void fromList(const json& list, size_t peers, std::vector<uint64_t>& firstOut,
+                         std::vector<int32_t>& targets, std::vector<uint32_t>& properties) {
+        std::vector<std::pair<int32_t, uint32_t>> row;
+        bool withProperties = false;
+        firstOut.assign(1, 0);
+        targets.clear();
+        properties.clear();
+        std::vector<uint32_t> rowProperties;
+        for (size_t i = 0; i < peers; ++i) {
+            row.clear();
+            auto it = list.find(std::to_string(i));
+            if (it != list.end()) {
+                for (auto& entry : *it) {
+                    if (entry.is_array()) {
+                        row.emplace_back(entry.at(0).get<int32_t>(), entry.at(1).get<uint32_t>());
+                        withProperties = true;
+                    } else {
+                        row.emplace_back(entry.get<int32_t>(), 0);
+                    }
+                }
+            }
+            // the first occurrence of a neighbor wins
+            std::stable_sort(row.begin(), row.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+            row.erase(std::unique(row.begin(), row.end(), [](const auto& a, const auto& b) { return a.first == b.first; }),
+                      row.end());
+            for (auto& [target, property] : row) {
+                targets.push_back(target);
+                rowProperties.push_back(property);
+            }
+            firstOut.push_back(targets.size());
+        }
+        if (withProperties) properties.swap(rowProperties);
+    }
+
+private:
+    struct Header {
+        char magic[4];
+        uint32_t version;
+        uint32_t flags;
+        uint32_t reserved{0};
+        uint64_t peers;
+        uint64_t edges;
+    };
+    static constexpr char MAGIC[4] = {'Q', 'T', 'O', 'P'};
+
+    const Header& header() const { return *reinterpret_cast<const Header*>(_data); }
+
+    [[noreturn]] void fail(const std::string& why) const {
+        throw std::runtime_error("topology file " + _path + ": " + why);
+    }
+
+    void map() {
+#ifdef QUANTAS_MMAP
+        int fd = ::open(_path.c_str(), O_RDONLY);
+        if (fd < 0) fail("cannot open");
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            ::close(fd);
+            fail("cannot stat");
+        }
+        _size = static_cast<size_t>(st.st_size);
+        if (_size > 0) {
+            void* p = ::mmap(nullptr, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) {
+                ::close(fd);
+                fail("cannot map");
+            }
+            _data = static_cast<const unsigned char*>(p);
+        }
+        ::close(fd);
+#else
+        std::ifstream in(_path, std::ios::binary);
+        if (!in) fail("cannot open");
+        _buffer.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+        _size = _buffer.size();
+        _data = reinterpret_cast<const unsigned char*>(_buffer.data());
+#endif
+    }
+
+    void unmap() {
+#ifdef QUANTAS_MMAP
+        if (_data != nullptr) ::munmap(const_cast<unsigned char*>(_data), _size);
+#endif
+        _data = nullptr;
+        _size = 0;
+    }
+
+    void check() const {
+        if (_size < sizeof(Header) || std::memcmp(header().magic, MAGIC, sizeof(MAGIC)) != 0) {
+            fail("not a topology file");
+        }
+        if (header().version != VERSION) fail("unsupported version " + std::to_string(header().version));
+        uint64_t peers = header().peers, edges = header().edges;
+        uint64_t expected = sizeof(Header) + (peers + 1) * sizeof(uint64_t) + edges * sizeof(int32_t)
+                          + ((header().flags & HAS_PROPERTIES) ? edges * sizeof(uint32_t) : 0);
+        if (peers > INT32_MAX || edges > _size || expected != _size) fail("truncated or wrong size");
+        const uint64_t* first = firstOut();
+        const int32_t* target = targets();
+        if (first[0] != 0 || first[peers] != edges) fail("rows do not cover the edges");
+        for (uint64_t i = 0; i < peers; ++i) {
+            if (first[i + 1] < first[i]) fail("rows out of order at peer " + std::to_string(i));
+            for (uint64_t k = first[i]; k < first[i + 1]; ++k) {
+                if (target[k] < 0 || static_cast<uint64_t>(target[k]) >= peers) {
+                    fail("neighbor " + std::to_string(target[k]) + " of peer " + std::to_string(i) + " out of range");
+                }
+                if (k > first[i] && target[k] <= target[k - 1]) {
+                    fail("neighbors of peer " + std::to_string(i) + " not ascending");
+                }
+            }
+        }
+    }
+
+    std::string _path;
+    const unsigned char* _data{nullptr};
+    size_t _size{0};
+#ifndef QUANTAS_MMAP
+    std::vector<char> _buffer;
+#endif
+};
+
+} // namespace quantas
+
+#endif /* TOPOLOGY_FILE_HPP */
@@ -431,12 +431,14 @@ void EthereumPeer::checkInStrm() {
 
     while (!inStreamEmpty()) {
         Packet packet = popInStream();
-        json msg = packet.getMessage();
+        const json& msg = packet.message();
         if (!msg.contains("type") || msg["type"] != "PoW") continue;
 
         const std::string messageType = msg.value("messageType", std::string());
         if (messageType == "transaction") {
-            const json& txJson = msg["transaction"];
+            auto txEntry = msg.find("transaction");
+            if (txEntry == msg.end() || !txEntry->is_object()) continue;
+            const json& txJson = *txEntry;
             int txId = txJson.value("id", -1);
             interfaceId submitter = txJson.value("submitter", msg.value("from_id", NO_PEER_ID));
             if (txId < 0 || submitter == NO_PEER_ID) continue;
@@ -449,7 +451,9 @@ void EthereumPeer::checkInStrm() {
                 _queue.push_back(pending);
             }
         } else if (messageType == "block") {
-            const json& blkJson = msg["block"];
+            auto blkEntry = msg.find("block");
+            if (blkEntry == msg.end() || !blkEntry->is_object()) continue;
+            const json& blkJson = *blkEntry;
             std::string hash = blkJson.value("hash", std::string());
 
             std::vector<std::string> parents;
@@ -41,10 +41,6 @@ static bool registerKademliaConcrete = []() {
         [](interfaceId /*pubId*/) { return new KademliaPeer(new NetworkInterfaceConcrete()); });
 }();
 
-int KademliaPeer::s_currentTransactionId = 1;
-std::vector<interfaceId> KademliaPeer::s_allPeerIds;
-int KademliaPeer::s_binaryIdSize = 1;
-
 KademliaPeer::~KademliaPeer() = default;
 
 KademliaPeer::KademliaPeer(const KademliaPeer& rhs)
@@ -58,30 +54,34 @@ KademliaPeer::KademliaPeer(const KademliaPeer& rhs)
       _totalHops(rhs._totalHops),
       _latency(rhs._latency),
       _alive(rhs._alive),
-      _initialized(rhs._initialized) {}
+      _initialized(rhs._initialized),
+      _nextTransactionId(rhs._nextTransactionId) {}
 
 KademliaPeer::KademliaPeer(NetworkInterface* networkInterface)
     : Peer(networkInterface) {}
 
 void KademliaPeer::initParameters(const std::vector<Peer*>& peers, json /*parameters*/) {
-    s_allPeerIds.clear();
-    s_allPeerIds.reserve(peers.size());
+    // every peer keeps its own copy; simulations running side by side share no state
+    std::vector<interfaceId> allPeerIds;
+    allPeerIds.reserve(peers.size());
     for (const auto* base : peers) {
-        s_allPeerIds.push_back(base->publicId());
+        allPeerIds.push_back(base->publicId());
     }
 
-    size_t peerCount = std::max<size_t>(1, s_allPeerIds.size());
-    s_binaryIdSize = static_cast<int>(std::ceil(std::log2(static_cast<double>(peerCount))));
-    if (s_binaryIdSize <= 0) s_binaryIdSize = 1;
+    size_t peerCount = std::max<size_t>(1, allPeerIds.size());
+    int binaryIdSize = static_cast<int>(std::ceil(std::log2(static_cast<double>(peerCount))));
+    if (binaryIdSize <= 0) binaryIdSize = 1;
 
     const int maxBits = static_cast<int>(sizeof(std::uint64_t) * 8);
-    if (s_binaryIdSize > maxBits) {
-        s_binaryIdSize = maxBits;
+    if (binaryIdSize > maxBits) {
+        binaryIdSize = maxBits;
     }
 
     for (auto* base : peers) {
         auto* peer = static_cast<KademliaPeer*>(base);
-        peer->applyGlobalParameters();
+        peer->_binaryIdSize = binaryIdSize;
+        peer->_allPeerIds = allPeerIds;
+        peer->applyParameters();
         peer->_requestsSatisfied = 0;
         peer->_totalHops = 0;
         peer->_latency = 0;
@@ -96,7 +96,7 @@ void KademliaPeer::performComputation() {
     ensureInitialized();
     if (!_initialized) return;
 
-    const std::set<interfaceId> neighborSet = neighbors();
+    const NeighborView neighborSet = neighbors();
     const size_t fingerprint = neighborFingerprint(neighborSet);
     if (_fingers.empty() || fingerprint != _lastNeighborFingerprint) {
         rebuildFingerTable(neighborSet);
@@ -108,7 +108,7 @@ void KademliaPeer::performComputation() {
 void KademliaPeer::checkInStrm() {
     while (!inStreamEmpty()) {
         Packet packet = popInStream();
-        json message = packet.getMessage();
+        json message = packet.takeMessage();
         if (!message.is_object()) continue;
         if (message.value("type", std::string()) != "Kademlia") continue;
         if (message.value("messageType", std::string()) != "lookup") continue;
@@ -128,7 +128,7 @@ void KademliaPeer::handleLookup(json msg) {
         return;
     }
 
-    const std::set<interfaceId> neighborSet = neighbors();
+    const NeighborView neighborSet = neighbors();
     if (neighborSet.empty()) return;
 
     std::string targetBinary = msg.value("targetBinaryId", std::string());
@@ -164,7 +164,7 @@ void KademliaPeer::submitLookup(int transactionId) {
         return;
     }
 
-    const std::set<interfaceId> neighborSet = neighbors();
+    const NeighborView neighborSet = neighbors();
     if (neighborSet.empty()) return;
 
     interfaceId nextHop = findRoute(targetBinary, targetId, neighborSet);
@@ -191,25 +191,15 @@ json KademliaPeer::makeLookupMessage(interfaceId targetId,
     return msg;
 }
 
-void KademliaPeer::applyGlobalParameters() {
-    if (s_binaryIdSize <= 0 || s_allPeerIds.empty()) return;
-    _binaryIdSize = s_binaryIdSize;
-    _allPeerIds = s_allPeerIds;
+void KademliaPeer::applyParameters() {
+    if (_binaryIdSize <= 0 || _allPeerIds.empty()) return;
     _binaryId = getBinaryId(publicId());
     _initialized = true;
 }
 
 void KademliaPeer::ensureInitialized() {
     if (!_initialized) {
-        applyGlobalParameters();
-    } else {
-        if (s_binaryIdSize > 0 && _binaryIdSize != s_binaryIdSize) {
-            _binaryIdSize = s_binaryIdSize;
-            _binaryId = getBinaryId(publicId());
-        }
-        if (!s_allPeerIds.empty()) {
-            _allPeerIds = s_allPeerIds;
-        }
+        applyParameters();
     }
 }
 
@@ -231,7 +221,7 @@ std::string KademliaPeer::getBinaryId(interfaceId id) const {
 
 interfaceId KademliaPeer::findRoute(const std::string& targetBinaryId,
                                     interfaceId targetId,
-                                    const std::set<interfaceId>& neighborSet) const {
+                                    NeighborView neighborSet) const {
     if (targetBinaryId.empty() || _binaryId.empty()) {
         return selectClosestByDistance(targetId, neighborSet);
     }
@@ -250,7 +240,7 @@ interfaceId KademliaPeer::findRoute(const std::string& targetBinaryId,
 }
 
 interfaceId KademliaPeer::selectFingerForGroup(int group,
-                                               const std::set<interfaceId>& neighborSet) const {
+                                               NeighborView neighborSet) const {
     std::vector<interfaceId> candidates;
     for (const auto& finger : _fingers) {
         if (finger.group != group) continue;
@@ -266,7 +256,7 @@ interfaceId KademliaPeer::selectFingerForGroup(int group,
 }
 
 interfaceId KademliaPeer::selectClosestByDistance(interfaceId targetId,
-                                                  const std::set<interfaceId>& neighborSet) const {
+                                                  NeighborView neighborSet) const {
     std::uint64_t selfDistance = xorDistance(publicId(), targetId);
     std::uint64_t bestDistance = selfDistance;
     interfaceId best = NO_PEER_ID;
@@ -293,7 +283,7 @@ int KademliaPeer::firstDifferentBit(const std::string& lhs, const std::string& r
     return -1;
 }
 
-void KademliaPeer::rebuildFingerTable(const std::set<interfaceId>& neighborSet) {
+void KademliaPeer::rebuildFingerTable(NeighborView neighborSet) {
     _fingers.clear();
     if (_binaryIdSize <= 0) {
         _lastNeighborFingerprint = neighborFingerprint(neighborSet);
@@ -325,7 +315,7 @@ void KademliaPeer::rebuildFingerTable(const std::set<interfaceId>& neighborSet)
     _lastNeighborFingerprint = neighborFingerprint(neighborSet);
 }
 
-size_t KademliaPeer::neighborFingerprint(const std::set<interfaceId>& neighborSet) const {
+size_t KademliaPeer::neighborFingerprint(NeighborView neighborSet) const {
     size_t hash = neighborSet.size();
     const size_t magic = static_cast<size_t>(0x9e3779b97f4a7c15ULL);
     for (interfaceId id : neighborSet) {
@@ -345,7 +335,7 @@ void KademliaPeer::endOfRound(std::vector<Peer*>& peers) {
 
     if (!typed.empty()) {
         int index = randMod(static_cast<int>(typed.size()));
-        typed[static_cast<size_t>(index)]->submitLookup(s_currentTransactionId++);
+        typed[static_cast<size_t>(index)]->submitLookup(_nextTransactionId++);
     }
 
     long long satisfied = 0;
@@ -42,27 +42,23 @@ private:
     void submitLookup(int transactionId);
 
     // helpers
-    void applyGlobalParameters();
+    void applyParameters();
     void ensureInitialized();
     std::string getBinaryId(interfaceId id) const;
     interfaceId findRoute(const std::string& targetBinaryId,
                           interfaceId targetId,
-                          const std::set<interfaceId>& neighborSet) const;
+                          NeighborView neighborSet) const;
     interfaceId selectFingerForGroup(int group,
-                                     const std::set<interfaceId>& neighborSet) const;
+                                     NeighborView neighborSet) const;
     interfaceId selectClosestByDistance(interfaceId targetId,
-                                        const std::set<interfaceId>& neighborSet) const;
+                                        NeighborView neighborSet) const;
     static int firstDifferentBit(const std::string& lhs, const std::string& rhs);
-    void rebuildFingerTable(const std::set<interfaceId>& neighborSet);
-    size_t neighborFingerprint(const std::set<interfaceId>& neighborSet) const;
+    void rebuildFingerTable(NeighborView neighborSet);
+    size_t neighborFingerprint(NeighborView neighborSet) const;
     json makeLookupMessage(interfaceId targetId,
                            const std::string& targetBinaryId,
                            int transactionId) const;
 
-    static int s_currentTransactionId;
-    static std::vector<interfaceId> s_allPeerIds;
-    static int s_binaryIdSize;
-
     int _binaryIdSize{0};
     std::string _binaryId{""};
     std::vector<interfaceId> _allPeerIds;
@@ -74,6 +70,7 @@ private:
     int _latency{0};
     bool _alive{true};
     bool _initialized{false};
+    int _nextTransactionId{1};   // of the lookups endOfRound submits, on the first peer
 };
 }
 #endif /* KademliaPeer_hpp */
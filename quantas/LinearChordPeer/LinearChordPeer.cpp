@@ -27,8 +27,6 @@ static bool registerLinearChordPeer = []() {
         [](interfaceId pubId) { return new LinearChordPeer(new NetworkInterfaceAbstract(pubId)); });
 }();
 
-int LinearChordPeer::s_nextTransactionId = 1;
-
 LinearChordPeer::LinearChordPeer(NetworkInterface* interfacePtr)
     : Peer(interfacePtr) {}
 
@@ -41,7 +39,8 @@ LinearChordPeer::LinearChordPeer(const LinearChordPeer& rhs)
       _initialized(rhs._initialized),
       _requestsSatisfied(rhs._requestsSatisfied),
       _totalHops(rhs._totalHops),
-      _totalLatency(rhs._totalLatency) {}
+      _totalLatency(rhs._totalLatency),
+      _nextTransactionId(rhs._nextTransactionId) {}
 
 void LinearChordPeer::initParameters(const std::vector<Peer*>& peers, json /*parameters*/) {
     std::vector<interfaceId> ringOrder;
@@ -78,7 +77,7 @@ void LinearChordPeer::performComputation() {
 void LinearChordPeer::checkInStrm() {
     while (!inStreamEmpty()) {
         Packet packet = popInStream();
-        json msg = packet.getMessage();
+        json msg = packet.takeMessage();
         if (!msg.contains("type") || msg["type"] != "LinearChord") continue;
         const std::string messageType = msg.value("messageType", std::string());
         if (messageType == "lookup") {
@@ -99,7 +98,7 @@ void LinearChordPeer::handleLookup(json msg) {
         return;
     }
 
-    const std::set<interfaceId> neighborSet = neighbors();
+    const NeighborView neighborSet = neighbors();
     interfaceId nextHop = selectFinger(target, neighborSet);
     if (nextHop == NO_PEER_ID) {
         nextHop = chooseClockwiseNeighbor(target, neighborSet);
@@ -119,7 +118,7 @@ void LinearChordPeer::submitLookup(int transactionId) {
         return;
     }
 
-    const std::set<interfaceId> neighborSet = neighbors();
+    const NeighborView neighborSet = neighbors();
     interfaceId nextHop = selectFinger(target, neighborSet);
     if (nextHop == NO_PEER_ID) {
         nextHop = chooseClockwiseNeighbor(target, neighborSet);
@@ -153,7 +152,7 @@ interfaceId LinearChordPeer::pickRandomTarget() const {
     return candidate;
 }
 
-interfaceId LinearChordPeer::selectFinger(interfaceId target, const std::set<interfaceId>& neighborSet) const {
+interfaceId LinearChordPeer::selectFinger(interfaceId target, NeighborView neighborSet) const {
     const size_t ringSize = _ringOrder.size();
     if (ringSize <= 1) return NO_PEER_ID;
 
@@ -178,7 +177,7 @@ interfaceId LinearChordPeer::selectFinger(interfaceId target, const std::set<int
 }
 
 interfaceId LinearChordPeer::chooseClockwiseNeighbor(interfaceId target,
-                                                        const std::set<interfaceId>& neighborSet) const {
+                                                        NeighborView neighborSet) const {
     const size_t ringSize = _ringOrder.size();
     if (ringSize <= 1 || neighborSet.empty()) return NO_PEER_ID;
 
@@ -217,7 +216,7 @@ interfaceId LinearChordPeer::chooseClockwiseNeighbor(interfaceId target,
 
 void LinearChordPeer::dispatchLookup(json msg,
                                         interfaceId nextHop,
-                                        const std::set<interfaceId>& neighborSet) {
+                                        NeighborView neighborSet) {
     if (nextHop == NO_PEER_ID || nextHop == publicId()) return;
     if (!neighborSet.count(nextHop)) return;
     msg["hops"] = msg.value("hops", 0) + 1;
@@ -264,7 +263,7 @@ void LinearChordPeer::endOfRound(std::vector<Peer*>& peers) {
 
     if (!typed.empty()) {
         int idx = randMod(static_cast<int>(typed.size()));
-        typed[static_cast<size_t>(idx)]->submitLookup(s_nextTransactionId++);
+        typed[static_cast<size_t>(idx)]->submitLookup(_nextTransactionId++);
     }
 
     long long totalSatisfied = 0;
@@ -41,9 +41,9 @@ private:
     void submitLookup(int transactionId);
     json makeLookupTemplate(interfaceId target, int transactionId) const;
     interfaceId pickRandomTarget() const;
-    interfaceId selectFinger(interfaceId target, const std::set<interfaceId>& neighborSet) const;
-    interfaceId chooseClockwiseNeighbor(interfaceId target, const std::set<interfaceId>& neighborSet) const;
-    void dispatchLookup(json msg, interfaceId nextHop, const std::set<interfaceId>& neighborSet);
+    interfaceId selectFinger(interfaceId target, NeighborView neighborSet) const;
+    interfaceId chooseClockwiseNeighbor(interfaceId target, NeighborView neighborSet) const;
+    void dispatchLookup(json msg, interfaceId nextHop, NeighborView neighborSet);
     void buildFingerTable();
 
     std::vector<interfaceId> _ringOrder;
@@ -55,8 +55,7 @@ private:
     int _requestsSatisfied = 0;
     int _totalHops = 0;
     int _totalLatency = 0;
-
-    static int s_nextTransactionId;
+    int _nextTransactionId = 1;   // of the lookups endOfRound submits, on the first peer
 };
 
 }
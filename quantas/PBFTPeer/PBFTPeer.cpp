@@ -258,17 +258,16 @@ public:
 
 void PBFTPeer::performComputation() {
 
-    while (!inStreamEmpty()) {
-        Packet packet = popInStream();
-        json msg = packet.getMessage();
+    drainInStream([this](Packet&& packet) {
+        const json& msg = packet.message();
         
         if (!msg.contains("type")) {
             std::cout << "Message requires a type" << std::endl;
-            continue;
+            return;
         }
         if (!msg.contains("consensusId")) {
             std::cout << "Message requires a consensusId" << std::endl;
-            continue;
+            return;
         }
         if (msg["type"] == "Request") {
             int targetId = msg["consensusId"];
@@ -283,22 +282,22 @@ void PBFTPeer::performComputation() {
             if (it != consensuses.end()) {
                 if (!msg.contains("seqNum")) {
                     std::cout << "Message requires a  a seqNum" << std::endl;
-                    continue;
+                    return;
                 }
                 int seq = msg["seqNum"];
                 if (!msg.contains("view")) {
                     std::cout << "Message requires a  a view" << std::endl;
-                    continue;
+                    return;
                 }
                 int view = msg["view"];
                 if (!msg.contains("MessageType")) {
                     std::cout << "Message requires a  a MessageType" << std::endl;
-                    continue;
+                    return;
                 }
                 string type = msg["MessageType"];
                 Consensus* base = it->second;
                 auto* target = dynamic_cast<PBFTConsensus*>(base);
-                if (!target) { std::cout << "message lost" << std::endl; continue; }
+                if (!target) { std::cout << "message lost" << std::endl; return; }
                 target->_receivedMessages[seq][view].insert({type, msg});
                 // std::cout << publicId() << " receive " << type << " in round " << RoundManager::currentRound() << "\n\n";
             } else {
@@ -308,7 +307,7 @@ void PBFTPeer::performComputation() {
             std::cout << "Other?" << std::endl;
         }
         // std::cout << std::endl;
-    }
+    });
 
     for (auto consensus : consensuses) {
         consensus.second->runPhase(this);
@@ -606,7 +606,7 @@ void RaftPeer::performComputation() {
 
     while (!inStreamEmpty()) {
         Packet packet = popInStream();
-        json msg = packet.getMessage();
+        json msg = packet.takeMessage();
 
         if (!msg.contains("type")) {
             continue;
@@ -41,7 +41,7 @@ void StableDataLinkPeer::performComputation() {
 
 	while (!inStreamEmpty()) {
 		Packet packet = popInStream();
-		json message = packet.getMessage();
+		json message = packet.takeMessage();
 		const std::string action = message.value("action", "");
 		const int messageNum = message.value("messageNum", -1);
 
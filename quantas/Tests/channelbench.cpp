@@ -0,0 +1,179 @@
+// Times building the initial channels of complete and torus networks with
+// Network::createChannels, sequentially and on a thread pool, and one round of
+// traffic over them: every peer broadcasts and then takes delivery. Then
+// compares building a whole network and the heap it uses with stored and
+// implicit ("implicit": true) neighbors, before and after a round in which
+// one peer in a hundred broadcasts. Last, the heap left behind by bursts of
+// traffic that move from peer to peer, which drained channels give back.
+//
+//     make channel_bench
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <new>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+#include <malloc.h>
+#include "../Common/Abstract/Network.hpp"
+
+// counted on the pool threads that build channels too
+static std::atomic<size_t> allocations{0};
+
+static void* countedAlloc(size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void* operator new(size_t size) { return countedAlloc(size); }
+void* operator new[](size_t size) { return countedAlloc(size); }
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete[](void* p, size_t) noexcept { std::free(p); }
+
+using namespace quantas;
+
+class BenchPeer : public Peer {
+public:
+    BenchPeer(NetworkInterface* networkInterface) : Peer(networkInterface) {}
+    void performComputation() override {}
+};
+
+static bool registerBenchPeer = PeerRegistry::registerPeerType(
+    "BenchPeer", [](interfaceId pubId) { return new BenchPeer(new NetworkInterfaceAbstract(pubId)); });
+
+// drops every channel but keeps the topology
+static void dropChannels(const std::vector<Peer*>& peers) {
+    for (auto* peer : peers) {
+        std::set<interfaceId> neighbors = peer->neighbors();
+        peer->clearAll();
+        for (auto nbr : neighbors) peer->addNeighbor(nbr);
+    }
+}
+
+template<typename F>
+static void measure(const char* name, size_t channels, const std::vector<Peer*>& peers, F build) {
+    dropChannels(peers);
+    allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    build();
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    std::printf("  %-12s %9.2f ms %7.1f ns/channel %6.2f allocations/channel\n",
+                name, ns / 1e6, double(ns) / channels, double(allocations) / channels);
+}
+
+// every peer broadcasts one message, the next round every peer receives
+static void broadcastRound(const char* name, size_t channels, const std::vector<Peer*>& peers) {
+    size_t delivered = 0;
+    allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (auto* peer : peers) peer->broadcast(json{{"from", peer->publicId()}});
+    RoundManager::incrementRound();
+    for (auto* peer : peers) {
+        peer->receive();
+        delivered += peer->drainInStream([](Packet&&) {});
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    std::printf("  %-12s %9.2f ms %7.1f ns/packet  %6.2f allocations/packet\n",
+                name, ns / 1e6, double(ns) / delivered, double(allocations) / delivered);
+    if (delivered != channels) std::printf("  delivered %zu of %zu packets\n", delivered, channels);
+}
+
+static void run(const json& topology) {
+    json distribution = {{"type", "uniform"}, {"maxDelay", 1}};
+    RoundManager::setCurrentRound(0);
+    RoundManager::setLastRound(100);
+
+    ChannelStore store;   // outlives the peers attached to it
+    Network network;
+    network.setDistribution(distribution);
+    network.initNetwork(topology);
+    std::vector<Peer*> peers;
+    size_t channels = 0;
+    for (int i = 0; i < topology["initialPeers"].get<int>(); ++i) {
+        peers.push_back(network[i]);
+        channels += network[i]->neighbors().size();
+    }
+    std::printf("%s, %zu peers, %zu channels\n", topology["type"].get<std::string>().c_str(),
+                peers.size(), channels);
+
+    unsigned threads = std::max(2u, std::thread::hardware_concurrency());
+    BS::thread_pool pool(threads);
+    measure("build", channels, peers, [&]() { Network::createChannels(store, peers, distribution); });
+    measure("build pool", channels, peers, [&]() { Network::createChannels(store, peers, distribution, &pool); });
+    broadcastRound("broadcast", channels, peers);
+}
+
+// heap in use in MB
+static double heapMB() {
+    struct mallinfo2 info = mallinfo2();
+    return (info.uordblks + info.hblkhd) / double(1 << 20);
+}
+
+static void sparseTraffic(json topology, bool implicit) {
+    RoundManager::setCurrentRound(0);
+    RoundManager::setLastRound(100);
+    topology["implicit"] = implicit;
+    double before = heapMB();
+    auto start = std::chrono::steady_clock::now();
+    {
+        Network network;
+        network.setDistribution({{"type", "uniform"}, {"maxDelay", 1}});
+        network.initNetwork(topology);
+        auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+            std::chrono::steady_clock::now() - start).count();
+        double built = heapMB();
+        int peers = topology["initialPeers"].get<int>();
+        for (int i = 0; i < peers; i += 100) network[i]->broadcast(json{{"from", i}});
+        RoundManager::incrementRound();
+        for (int i = 0; i < peers; ++i) network[i]->receive();
+        std::printf("  %-12s %7lld ms build %8.1f MB heap %8.1f MB after traffic\n",
+                    implicit ? "implicit" : "stored", (long long)ms, built - before, heapMB() - before);
+    }
+}
+
+// every round five peers send ten messages to everyone, and everyone takes delivery
+static void rollingBursts(int peers, int rounds) {
+    RoundManager::setCurrentRound(0);
+    RoundManager::setLastRound(rounds + 1);
+    double before = heapMB();
+    Network network;
+    network.setDistribution({{"type", "uniform"}, {"maxDelay", 1}, {"maxMsgsRec", 1000}});
+    network.initNetwork({{"type", "complete"}, {"initialPeers", peers}, {"initialPeerType", "BenchPeer"}});
+    double built = heapMB();
+    for (int round = 0; round < rounds; ++round) {
+        for (int k = 0; k < 5; ++k) {
+            Peer* peer = network[(round * 5 + k) % peers];
+            for (int m = 0; m < 10; ++m) peer->broadcast(json{{"m", m}});
+        }
+        RoundManager::incrementRound();
+        for (int i = 0; i < peers; ++i) {
+            network[i]->receive();
+            network[i]->drainInStream([](Packet&&) {});
+        }
+    }
+    std::printf("  %-12s %8.1f MB heap %8.1f MB after %d rounds\n", "bursts", built - before, heapMB() - before, rounds);
+}
+
+int main() {
+    run({{"type", "complete"}, {"initialPeers", 1000}, {"initialPeerType", "BenchPeer"}});
+    run({{"type", "torus"}, {"initialPeers", 10000}, {"height", 100}, {"width", 100}, {"initialPeerType", "BenchPeer"}});
+
+    json complete = {{"type", "complete"}, {"initialPeers", 2000}, {"initialPeerType", "BenchPeer"}};
+    json torus = {{"type", "torus"}, {"initialPeers", 250000}, {"height", 500}, {"width", 500}, {"initialPeerType", "BenchPeer"}};
+    std::printf("complete, 2000 peers\n");
+    sparseTraffic(complete, false);
+    sparseTraffic(complete, true);
+    std::printf("torus, 250000 peers\n");
+    sparseTraffic(torus, false);
+    sparseTraffic(torus, true);
+    std::printf("complete, 500 peers\n");
+    rollingBursts(500, 100);
+    return 0;
+}
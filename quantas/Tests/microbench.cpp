@@ -0,0 +1,349 @@
+// Microbenchmarks of the simulator core: channel push and pop, broadcast
+// fan-out, in-stream drain, PoW block insertion and best tip selection at
+// growing DAG sizes, PBFT quorum counting, logged values and random draws.
+// Each benchmark is timed over several runs and reports the median and the
+// fastest time per operation. The results are written to a json file. Given
+// an earlier file, every benchmark whose fastest run is slower by more than
+// the threshold is flagged and the exit status is 1 (the fastest run is the
+// one least disturbed by the rest of the machine).
+//
+//     make bench [BENCHFILE=bench.json] [BASELINE=earlier.json]
+//     microbench [--out bench.json] [--compare earlier.json] [--threshold 10]
+//                [--filter text] [--runs 5]
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <functional>
+#include <string>
+#include <vector>
+#include "../Common/Abstract/Network.hpp"
+#include "../Common/Pow.hpp"
+#include "../PBFTPeer/PBFTPeer.cpp"   // PBFTConsensus is local to it
+
+using namespace quantas;
+
+static volatile uint64_t sink = 0;   // keeps the results of the timed code alive
+
+// batch() runs some operations and returns how many; prepare(), if set, runs
+// untimed before every batch
+struct Benchmark {
+    std::string name;
+    std::function<size_t()> batch;
+    std::function<void()> prepare;
+};
+
+struct Result {
+    double median;   // ns per operation
+    double min;
+    size_t ops;
+};
+
+// one run: batches until at least minNs have been timed
+static std::pair<double, size_t> timeRun(const Benchmark& b, double minNs) {
+    double ns = 0;
+    size_t ops = 0;
+    while (ns < minNs) {
+        if (b.prepare) b.prepare();
+        auto start = std::chrono::steady_clock::now();
+        size_t done = b.batch();
+        ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+        if (done == 0) {
+            std::fprintf(stderr, "%s did nothing\n", b.name.c_str());
+            std::exit(1);
+        }
+        ops += done;
+    }
+    return {ns, ops};
+}
+
+static Result measure(const Benchmark& b, int runs) {
+    timeRun(b, 5e6);   // warm up caches, allocators and the branch predictor
+    std::vector<double> perOp;
+    size_t ops = 0;
+    for (int r = 0; r < runs; ++r) {
+        auto [ns, count] = timeRun(b, 20e6);
+        perOp.push_back(ns / count);
+        ops += count;
+    }
+    std::sort(perOp.begin(), perOp.end());
+    return Result{perOp[perOp.size() / 2], perOp.front(), ops};
+}
+
+// -------------------------------- channels --------------------------------
+
+class BenchPeer : public Peer {
+public:
+    BenchPeer(NetworkInterface* networkInterface) : Peer(networkInterface) {}
+    void performComputation() override {}
+};
+
+static bool registerBenchPeer = PeerRegistry::registerPeerType(
+    "BenchPeer", [](interfaceId pubId) { return new BenchPeer(new NetworkInterfaceAbstract(pubId)); });
+
+struct BenchMessage { int from; int round; };
+static messageTag benchTag = MessageRegistry::registerMessageType<BenchMessage>("BenchMessage");
+
+static json smallMessage(int i) {
+    return json{{"type", "Consensus"}, {"MessageType", "prepare"}, {"seqNum", i}, {"from_id", 7}};
+}
+
+// a thousand packets through one channel: pushed, then popped the next round
+static void channelBenchmarks(std::vector<Benchmark>& benchmarks) {
+    auto store = std::make_shared<ChannelStore>();
+    store->reset(std::vector<size_t>{0, 1});
+    ChannelProperties* properties = ChannelPropertiesFactory::instance().create(json{{"type", "ONE"}, {"maxMsgsRec", INT_MAX}});
+    store->connect(0, 0, 1, 1, 0, 0, store->propertiesIndex(properties), INT_MAX);
+    benchmarks.push_back({"channel/push-pop", [store]() {
+        const int packets = 1000;
+        for (int i = 0; i < packets; ++i) {
+            Packet p;
+            p.setMessage(smallMessage(i));
+            store->pushPacket(0, std::move(p));
+        }
+        RoundManager::incrementRound();
+        while (store->frontHasArrived(0)) sink += store->popPacket(0).getMessage()["seqNum"].get<int>();
+        return size_t(packets);
+    }, nullptr});
+}
+
+// every peer of a complete network broadcasts; timed are the sends, and
+// separately the receive and drain of everything sent
+static void broadcastBenchmarks(std::vector<Benchmark>& benchmarks, int peers) {
+    auto network = std::make_shared<Network>();
+    network->setDistribution({{"type", "uniform"}, {"maxDelay", 1}, {"maxMsgsRec", 1000}});
+    network->initNetwork({{"type", "complete"}, {"initialPeers", peers}, {"initialPeerType", "BenchPeer"}});
+    const size_t packets = size_t(peers) * (peers - 1);
+    std::string suffix = "/complete-" + std::to_string(peers);
+
+    auto deliver = [network, peers]() {
+        RoundManager::incrementRound();
+        size_t delivered = 0;
+        for (int i = 0; i < peers; ++i) {
+            (*network)[i]->receive();
+            delivered += (*network)[i]->drainInStream([](Packet&& p) { sink += p.sourceId(); });
+        }
+        return delivered;
+    };
+    auto sendJson = [network, peers, packets]() {
+        for (int i = 0; i < peers; ++i) (*network)[i]->broadcast(json{{"from", i}});
+        return packets;
+    };
+    auto sendPayload = [network, peers, packets]() {
+        for (int i = 0; i < peers; ++i) {
+            (*network)[i]->broadcastPayload(Payload(BenchMessage{i, int(RoundManager::currentRound())}));
+        }
+        return packets;
+    };
+    // the previous batch's packets are delivered untimed
+    benchmarks.push_back({"broadcast/json" + suffix, sendJson, [deliver]() { deliver(); }});
+    benchmarks.push_back({"broadcast/payload" + suffix, sendPayload, [deliver]() { deliver(); }});
+    benchmarks.push_back({"drain/json" + suffix, deliver, [sendJson]() { sendJson(); }});
+    benchmarks.push_back({"drain/payload" + suffix, deliver, [sendPayload]() { sendPayload(); }});
+}
+
+// ----------------------------------- PoW -----------------------------------
+
+// A chain of blocks, every fourth also referencing the block three below it.
+// Timed: the parents for the next block, the tips, and last (it adds blocks)
+// a block forking off one of the 64 below the tip, which keeps the ancestry
+// the ledger walks as long.
+static void powBenchmarks(std::vector<Benchmark>& benchmarks, int blocks) {
+    auto pow = std::make_shared<PoW>(new Committee(0));
+    std::vector<std::string> hashes{"GENESIS"};
+    for (int i = 1; i <= blocks; ++i) {
+        std::vector<std::string> parents{hashes[i - 1]};
+        if (i % 4 == 0) parents.push_back(hashes[i - 3]);
+        hashes.push_back("b" + std::to_string(i));
+        pow->registerBlock(hashes.back(), parents, i % 16, i, i);
+    }
+    std::string suffix = "/" + std::to_string(blocks);
+    auto forks = std::make_shared<int>(0);
+
+    benchmarks.push_back({"pow/bestTip" + suffix, [pow]() {
+        const int count = 1000;
+        for (int k = 0; k < count; ++k) sink += pow->parentsForNextBlock().size();
+        return size_t(count);
+    }, nullptr});
+    benchmarks.push_back({"pow/tips" + suffix, [pow]() {
+        sink += pow->tips().size();
+        return size_t(1);
+    }, nullptr});
+    benchmarks.push_back({"pow/registerBlock" + suffix, [pow, hashes, forks]() {
+        const int count = 4;
+        for (int k = 0; k < count; ++k) {
+            const std::string& parent = hashes[hashes.size() - 2 - *forks % std::min<size_t>(64, hashes.size() - 1)];
+            sink += pow->registerBlock("f" + std::to_string((*forks)++), {parent}, 1, 0, 0).height;
+        }
+        return size_t(count);
+    }, nullptr});
+}
+
+// ---------------------------------- PBFT ----------------------------------
+
+// a committee that has every member's prepare and commit for one request;
+// timed: the prepared and committed checks each member makes
+static void pbftBenchmarks(std::vector<Benchmark>& benchmarks, int members) {
+    Committee* committee = new Committee(0);
+    for (int i = 0; i < members; ++i) committee->addMember(i);
+    auto consensus = std::make_shared<PBFTConsensus>(committee);
+    json request = {{"type", "Request"}, {"requestId", 0}, {"submitterId", 0}, {"consensusId", 0},
+                    {"roundSubmitted", 0}, {"fault_flip", false}};
+    json prePrepare = {{"type", "Consensus"}, {"consensusId", 0}, {"MessageType", "pre-prepare"}, {"seqNum", 0},
+                       {"view", 0}, {"proposal", {{"Request", request}, {"view", 0}}}, {"from_id", consensus->leaderFor(0)}};
+    auto& received = consensus->_receivedMessages[0][0];
+    received.insert({"pre-prepare", prePrepare});
+    for (int i = 0; i < members; ++i) {
+        for (const char* type : {"prepare", "commit"}) {
+            json m = prePrepare;
+            m["MessageType"] = type;
+            m["from_id"] = i;
+            received.insert({type, m});
+        }
+    }
+    std::string digest = consensus->digestOf(request);
+
+    benchmarks.push_back({"pbft/quorum/committee-" + std::to_string(members), [consensus, digest]() {
+        const int count = 10;
+        for (int k = 0; k < count; ++k) {
+            sink += consensus->isPrepared(0, 0, digest) + consensus->isCommitted(0, 0, digest);
+        }
+        return size_t(count);
+    }, nullptr});
+}
+
+// ----------------------------------- log -----------------------------------
+
+static void logBenchmarks(std::vector<Benchmark>& benchmarks) {
+    const int values = 1000;
+    auto push = [values]() {
+        for (int i = 0; i < values; ++i) LogWriter::pushValue("metric", i);
+        return size_t(values);
+    };
+    // kept in memory, dropped untimed between batches (print with no log file)
+    benchmarks.push_back({"log/pushValue/json", push, []() {
+        LogWriter::setLogFile("/dev/null", "json");
+        LogWriter::print();
+    }});
+    benchmarks.push_back({"log/pushValue/ndjson", push, []() { LogWriter::setLogFile("/dev/null", "ndjson"); }});
+    // as during a phase: into the thread's buffer, merged at the end
+    benchmarks.push_back({"log/pushValue/buffered", [push]() {
+        LogWriter::Buffered buffered;
+        return push();
+    }, []() { LogWriter::setLogFile("/dev/null", "ndjson"); }});
+}
+
+// ----------------------------------- RNG -----------------------------------
+
+static void randomBenchmarks(std::vector<Benchmark>& benchmarks) {
+    const int draws = 4096;
+    benchmarks.push_back({"rng/uniformInt", [draws]() {
+        for (int i = 0; i < draws; ++i) sink += uniformInt(0, 99);
+        return size_t(draws);
+    }, nullptr});
+    benchmarks.push_back({"rng/fillUniformInt", [draws]() {
+        static std::vector<int> out(draws);
+        fillUniformInt(out.data(), out.size(), 0, 99);
+        sink += out[draws - 1];
+        return size_t(draws);
+    }, nullptr});
+    benchmarks.push_back({"rng/uniformReal", [draws]() {
+        double sum = 0;
+        for (int i = 0; i < draws; ++i) sum += uniformReal(0.0, 1.0);
+        sink += uint64_t(sum);
+        return size_t(draws);
+    }, nullptr});
+    benchmarks.push_back({"rng/trueWithProbability", [draws]() {
+        for (int i = 0; i < draws; ++i) sink += trueWithProbability(0.3);
+        return size_t(draws);
+    }, nullptr});
+    // what the network does before every peer acts
+    benchmarks.push_back({"rng/reseat", [draws]() {
+        RandomStream& engine = threadLocalEngine();
+        for (int i = 0; i < draws; ++i) {
+            engine.reseat(42, uint32_t(i), 7, 2);
+            sink += engine();
+        }
+        return size_t(draws);
+    }, nullptr});
+}
+
+// ---------------------------------------------------------------------------
+
+// prints the change of every benchmark's fastest run, true if none slowed
+// down by more than threshold percent
+static bool compare(const json& baseline, const json& results, double threshold) {
+    bool ok = true;
+    std::printf("\n%-36s %12s %12s %9s\n", "compared to baseline", "baseline min", "now min", "change");
+    for (auto& [name, now] : results.items()) {
+        if (!baseline.contains(name)) {
+            std::printf("%-36s %12s %12.1f %9s\n", name.c_str(), "-", now["min_ns_per_op"].get<double>(), "new");
+            continue;
+        }
+        double before = baseline[name]["min_ns_per_op"].get<double>();
+        double after = now["min_ns_per_op"].get<double>();
+        double change = (after / before - 1) * 100;
+        bool slower = change > threshold;
+        ok = ok && !slower;
+        std::printf("%-36s %12.1f %12.1f %+8.1f%%%s\n", name.c_str(), before, after, change,
+                    slower ? "  REGRESSION" : (change < -threshold ? "  faster" : ""));
+    }
+    return ok;
+}
+
+int main(int argc, char* argv[]) {
+    std::string out = "bench.json", baselineFile, filter;
+    double threshold = 10;
+    int runs = 5;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--out") out = argv[i + 1];
+        else if (arg == "--compare") baselineFile = argv[i + 1];
+        else if (arg == "--threshold") threshold = std::stod(argv[i + 1]);
+        else if (arg == "--filter") filter = argv[i + 1];
+        else if (arg == "--runs") runs = std::max(1, std::stoi(argv[i + 1]));
+        else {
+            std::fprintf(stderr, "unknown option %s\n", arg.c_str());
+            return 2;
+        }
+    }
+
+    std::setvbuf(stdout, nullptr, _IOLBF, 0);   // a line per benchmark as it finishes
+    RoundManager::setCurrentRound(0);
+    // far enough for every batch to be a round; the channels' throughput is
+    // maxMsgsRec times the rounds left, which must fit an int
+    RoundManager::setLastRound(1 << 20);
+    std::vector<Benchmark> benchmarks;
+    channelBenchmarks(benchmarks);
+    broadcastBenchmarks(benchmarks, 64);
+    broadcastBenchmarks(benchmarks, 256);
+    for (int blocks : {250, 1000, 4000}) powBenchmarks(benchmarks, blocks);
+    for (int members : {4, 16, 64}) pbftBenchmarks(benchmarks, members);
+    logBenchmarks(benchmarks);
+    randomBenchmarks(benchmarks);
+
+    json results = json::object();
+    std::printf("%-36s %12s %12s\n", "benchmark", "median ns/op", "min ns/op");
+    for (const Benchmark& b : benchmarks) {
+        if (b.name.find(filter) == std::string::npos) continue;
+        Result r = measure(b, runs);
+        results[b.name] = {{"ns_per_op", r.median}, {"min_ns_per_op", r.min}, {"ops", r.ops}};
+        std::printf("%-36s %12.1f %12.1f\n", b.name.c_str(), r.median, r.min);
+    }
+
+    std::ofstream file(out);
+    file << json{{"runs", runs}, {"benchmarks", results}}.dump(4) << std::endl;
+    std::printf("\nwrote %s\n", out.c_str());
+
+    if (baselineFile.empty()) return 0;
+    std::ifstream in(baselineFile);
+    if (!in) {
+        std::fprintf(stderr, "cannot open %s\n", baselineFile.c_str());
+        return 2;
+    }
+    json baseline = json::parse(in);
+    return compare(baseline.value("benchmarks", json::object()), results, threshold) ? 0 : 1;
+}
@@ -0,0 +1,111 @@
+// Compares heap allocations and time per delivered packet when a json message
+// is copied at every hop (send, channel, receive) against moving it through.
+//
+//     make packet_bench
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <deque>
+#include <new>
+#include <string>
+#include "../Common/Abstract/Channel.hpp"
+
+static size_t allocations = 0;
+
+void* operator new(size_t size) {
+    ++allocations;
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, size_t) noexcept { std::free(p); }
+
+using namespace quantas;
+
+static json makeMessage(int i) {
+    return json{
+        {"type", "Consensus"},
+        {"MessageType", "prepare"},
+        {"seqNum", i},
+        {"view", 0},
+        {"digest", "d41d8cd98f00b204e9800998ecf8427e"},
+        {"from_id", 7}
+    };
+}
+
+// copying: every hop takes its own copy of the message
+static long sendCopying(ChannelStore& channel, std::deque<Packet>& inStream, int count) {
+    long checksum = 0;
+    for (int i = 0; i < count; ++i) {
+        json msg = makeMessage(i);
+        Packet p;
+        p.setMessage(msg);
+        channel.pushPacket(0, p);
+    }
+    RoundManager::incrementRound();
+    while (channel.frontHasArrived(0)) {
+        Packet p = channel.popPacket(0);
+        inStream.push_back(p);
+    }
+    while (!inStream.empty()) {
+        Packet p = inStream.front();
+        inStream.pop_front();
+        json msg = p.getMessage();
+        checksum += msg["seqNum"].get<int>();
+    }
+    return checksum;
+}
+
+// moving: the message built by the sender is the one the receiver reads
+static long sendMoving(ChannelStore& channel, std::deque<Packet>& inStream, int count) {
+    long checksum = 0;
+    for (int i = 0; i < count; ++i) {
+        json msg = makeMessage(i);
+        Packet p;
+        p.setMessage(std::move(msg));
+        channel.pushPacket(0, std::move(p));
+    }
+    RoundManager::incrementRound();
+    while (channel.frontHasArrived(0)) {
+        inStream.push_back(channel.popPacket(0));
+    }
+    while (!inStream.empty()) {
+        Packet p = std::move(inStream.front());
+        inStream.pop_front();
+        json msg = p.takeMessage();
+        checksum += msg["seqNum"].get<int>();
+    }
+    return checksum;
+}
+
+template<typename F>
+static void run(const char* name, F send) {
+    const int packets = 1000;
+    const int rounds = 200;
+    RoundManager::setCurrentRound(0);
+    RoundManager::setLastRound(rounds + 1);
+    ChannelStore channel;
+    channel.reset(std::vector<size_t>{0, 1});
+    ChannelProperties* properties = ChannelPropertiesFactory::instance().create(json{{"type", "ONE"}, {"maxMsgsRec", packets}});
+    channel.connect(0, 0, 1, 1, 0, 0, channel.propertiesIndex(properties), packets * (rounds + 1));
+    std::deque<Packet> inStream;
+
+    long checksum = send(channel, inStream, packets); // warm up the containers
+    allocations = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (int r = 1; r < rounds; ++r) {
+        checksum += send(channel, inStream, packets);
+    }
+    auto ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count();
+    double delivered = double(packets) * (rounds - 1);
+    std::printf("%-8s %6.2f allocations/packet %8.1f ns/packet (checksum %ld)\n",
+                name, allocations / delivered, ns / delivered, checksum);
+}
+
+int main() {
+    run("copy", sendCopying);
+    run("move", sendMoving);
+    return 0;
+}
@@ -1,7 +1,9 @@
 #include <iostream>
 #include <thread>
 #include <vector>
+#include <array>
 #include <cassert>
+#include <utility>
 #include "../Common/RandomUtil.hpp"
 
 void getRandomInts(std::vector<int> &randomInts, int howMany)
@@ -46,5 +48,42 @@ int main()
         }
     }
 
+    // Philox4x32-10 known answers (Random123 kat_vectors)
+    std::array<uint32_t, 4> block = quantas::philox4x32({0, 0, 0, 0}, {0, 0});
+    assert((block == std::array<uint32_t, 4>{0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8}));
+    block = quantas::philox4x32({0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344}, {0xa4093822, 0x299f31d0});
+    assert((block == std::array<uint32_t, 4>{0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1}));
+
+    // a positioned stream draws the same on any thread, batched or not
+    std::vector<uint32_t> batch(37), onOtherThread(37);
+    quantas::RandomStream stream(42, 7, 3, 1);
+    stream();
+    stream.fill(batch.data(), batch.size());
+    std::thread([&onOtherThread]() {
+        quantas::threadLocalEngine().reseat(42, 7, 3, 1);
+        quantas::threadLocalEngine()();
+        for (auto &draw : onOtherThread)
+        {
+            draw = quantas::threadLocalEngine()();
+        }
+    }).join();
+    assert(batch == onOtherThread);
+
+    // batched integers match one draw at a time, rejections included
+    for (auto [minVal, maxVal] : {std::pair<int, int>{-5, 99}, {-5, (1 << 30) + 1}, {INT32_MIN, INT32_MAX}})
+    {
+        std::vector<int> filled(1000), single(1000);
+        quantas::threadLocalEngine().reseat(9, 1, 2, 3);
+        quantas::fillUniformInt(filled.data(), filled.size(), minVal, maxVal);
+        uint32_t after = quantas::threadLocalEngine()();
+        quantas::threadLocalEngine().reseat(9, 1, 2, 3);
+        for (auto &draw : single)
+        {
+            draw = quantas::uniformInt(minVal, maxVal);
+        }
+        assert(filled == single);
+        assert(after == quantas::threadLocalEngine()());
+    }
+
     return 0;
 }
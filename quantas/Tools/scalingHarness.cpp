@@ -0,0 +1,228 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Runs one experiment of an input file over a sweep of peer and thread
+// counts. Prints rounds/s, packets/s, parallel efficiency and peak memory as
+// a table and writes them as CSV.
+//
+//     make scaling INPUTFILE=quantas/PBFTPeer/PBFTInput.json PEERS=64,256 THREADS=1,2,4
+//     scalingHarness quantas.exe input.json [--experiment 0] [--peers 64,256]
+//                    [--threads 1,2,4] [--mode strong|weak] [--repeat 1]
+//                    [--csv scaling.csv]
+//
+// strong: every peer count is run with every thread count. Efficiency is the
+//         speedup over the fewest threads divided by the extra threads.
+// weak:   the peer counts are per thread, so n threads run n times as many
+//         peers. Efficiency is the peer-rounds/s per thread relative to the
+//         fewest threads.
+//
+// Every point runs in its own process (the simulator given), so its peak
+// memory is its own. The simulator caps the threads at the number of peers;
+// the "threads" column shows the threads a point actually got. Topologies
+// given as a list or a file keep their peers, only the threads are swept.
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../Common/Json.hpp"
+
+using nlohmann::json;
+namespace fs = std::filesystem;
+
+struct Point {
+    int peers = 0;
+    int requested = 0;   // threads asked for
+    int threads = 0;     // threads the simulator used
+    double seconds = 0;
+    double rounds = 0;   // over all tests
+    double packets = 0;
+    size_t memoryKB = 0;
+    double efficiency = 0;
+};
+
+static std::vector<int> parseList(const std::string& text) {
+    std::vector<int> values;
+    std::stringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ',')) {
+        if (!item.empty()) values.push_back(std::stoi(item));
+    }
+    return values;
+}
+
+// the experiment with peers peers, false if its topology cannot be resized
+static bool resize(json& experiment, int peers) {
+    json& topology = experiment["topology"];
+    std::string type = topology.value("type", "");
+    if (type == "list" || type == "file" || topology.contains("list")) {
+        return topology.value("initialPeers", 0) == peers;
+    }
+    if (type == "grid" || type == "torus") {
+        // the closest square
+        int side = std::max(1, int(std::lround(std::sqrt(double(peers)))));
+        topology["height"] = side;
+        topology["width"] = side;
+        peers = side * side;
+    }
+    topology["initialPeers"] = peers;
+    return true;
+}
+
+// runs the experiment in a process of its own, false if it failed
+static bool runPoint(const std::string& simulator, const json& algorithms, json experiment,
+                     const fs::path& dir, Point& point) {
+    fs::path input = dir / "point.json";
+    fs::path log = dir / "point_log.json";
+    experiment["threadCount"] = point.requested;
+    experiment["logFile"] = log.string();
+    experiment["logFormat"] = "json";
+    experiment["countPackets"] = true;
+    experiment["parallelTests"] = 1;
+    experiment.erase("profile");
+    std::ofstream(input) << json{{"algorithms", algorithms}, {"experiments", json::array({experiment})}}.dump();
+    fs::remove(log);
+
+#if defined(_WIN32)
+    std::string quiet = " > NUL";
+#else
+    std::string quiet = " > /dev/null";
+#endif
+    std::string command = "\"" + simulator + "\" \"" + input.string() + "\"" + quiet;
+    if (std::system(command.c_str()) != 0) return false;
+
+    std::ifstream in(log);
+    if (!in) return false;
+    json result = json::parse(in);
+    point.seconds = result.value("RunTime", 0.0);
+    point.memoryKB = result.value("Peak Memory KB", result.value("Previous Peak Memory KB", size_t(0)));
+    point.peers = experiment["topology"]["initialPeers"];
+    point.threads = std::min(point.requested, point.peers);
+    point.rounds = experiment["tests"].get<double>() * experiment["rounds"].get<double>();
+    point.packets = 0;
+    for (const json& test : result.value("tests", json::array())) {
+        for (const json& delivered : test.value("packetsDelivered", json::array())) point.packets += delivered.get<double>();
+    }
+    return point.seconds > 0;
+}
+
+static void print(const Point& p) {
+    std::printf("%8d %8d %10.3f %12.1f %14.0f %16.0f %10.2f %10.1f\n", p.peers, p.threads, p.seconds,
+                p.rounds / p.seconds, p.packets / p.seconds, p.rounds * p.peers / p.seconds,
+                p.efficiency, p.memoryKB / 1024.0);
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " quantas.exe input.json [--experiment 0] [--peers 64,256]"
+                  << " [--threads 1,2,4] [--mode strong|weak] [--repeat 1] [--csv scaling.csv]" << std::endl;
+        return 1;
+    }
+    std::string simulator = argv[1], inputFile = argv[2];
+    std::string mode = "strong", csvFile = "scaling.csv", peerList, threadList;
+    int experimentIndex = 0, repeat = 1;
+    for (int i = 3; i + 1 < argc; i += 2) {
+        std::string arg = argv[i];
+        if (arg == "--experiment") experimentIndex = std::stoi(argv[i + 1]);
+        else if (arg == "--peers") peerList = argv[i + 1];
+        else if (arg == "--threads") threadList = argv[i + 1];
+        else if (arg == "--mode") mode = argv[i + 1];
+        else if (arg == "--repeat") repeat = std::max(1, std::stoi(argv[i + 1]));
+        else if (arg == "--csv") csvFile = argv[i + 1];
+        else {
+            std::cerr << "unknown option " << arg << std::endl;
+            return 1;
+        }
+    }
+    if (mode != "strong" && mode != "weak") {
+        std::cerr << "--mode is strong or weak" << std::endl;
+        return 1;
+    }
+
+    std::ifstream in(inputFile);
+    if (!in) {
+        std::cerr << "error: cannot open input file: " << inputFile << std::endl;
+        return 1;
+    }
+    json config = json::parse(in);
+    const json base = config["experiments"].at(experimentIndex);
+
+    std::vector<int> peerCounts = parseList(peerList);
+    if (peerCounts.empty()) peerCounts.push_back(base["topology"]["initialPeers"]);
+    std::vector<int> threadCounts = parseList(threadList);
+    if (threadCounts.empty()) {
+        unsigned cores = std::max(1u, std::thread::hardware_concurrency());
+        for (unsigned t = 1; t < cores; t *= 2) threadCounts.push_back(int(t));
+        threadCounts.push_back(int(cores));
+    }
+    std::sort(threadCounts.begin(), threadCounts.end());
+    threadCounts.erase(std::unique(threadCounts.begin(), threadCounts.end()), threadCounts.end());
+
+    fs::path dir = fs::temp_directory_path() / ("quantas_scaling_" + std::to_string(std::hash<std::string>{}(inputFile + csvFile)));
+    fs::create_directories(dir);
+
+    std::printf("%s scaling of %s, experiment %d\n", mode.c_str(), inputFile.c_str(), experimentIndex);
+    std::printf("%8s %8s %10s %12s %14s %16s %10s %10s\n", "peers", "threads", "seconds", "rounds/s",
+                "packets/s", "peer-rounds/s", "efficiency", "peak MB");
+    std::vector<Point> points;
+    for (int peers : peerCounts) {
+        double baseRate = 0;
+        int baseThreads = 0;
+        for (int threads : threadCounts) {
+            json experiment = base;
+            int total = mode == "weak" ? peers * threads : peers;
+            if (!resize(experiment, total)) {
+                std::cerr << "the topology of this experiment has a fixed number of peers, keeping "
+                          << experiment["topology"]["initialPeers"] << std::endl;
+            }
+            // the fastest of repeat runs
+            Point best;
+            best.requested = threads;
+            bool ok = false;
+            for (int r = 0; r < repeat; ++r) {
+                Point point;
+                point.requested = threads;
+                if (!runPoint(simulator, config["algorithms"], experiment, dir, point)) continue;
+                if (!ok || point.seconds < best.seconds) best = point;
+                ok = true;
+            }
+            if (!ok) {
+                std::cerr << "run with " << total << " peers and " << threads << " threads failed" << std::endl;
+                continue;
+            }
+            // strong: rounds/s, weak: peer-rounds/s, per thread over the fewest threads'
+            double rate = (mode == "weak" ? best.rounds * best.peers : best.rounds) / best.seconds;
+            if (baseThreads == 0) {
+                baseRate = rate;
+                baseThreads = best.threads;
+            }
+            best.efficiency = (rate / baseRate) * baseThreads / best.threads;
+            points.push_back(best);
+            print(best);
+        }
+    }
+    fs::remove_all(dir);
+
+    std::ofstream csv(csvFile);
+    csv << "mode,peers,threads,requested_threads,seconds,rounds_per_sec,packets_per_sec,peer_rounds_per_sec,efficiency,peak_memory_kb\n";
+    for (const Point& p : points) {
+        csv << mode << ',' << p.peers << ',' << p.threads << ',' << p.requested << ',' << p.seconds << ','
+            << p.rounds / p.seconds << ',' << p.packets / p.seconds << ',' << p.rounds * p.peers / p.seconds << ','
+            << p.efficiency << ',' << p.memoryKB << '\n';
+    }
+    std::printf("\nwrote %s\n", csvFile.c_str());
+    return 0;
+}
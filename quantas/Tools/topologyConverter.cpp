@@ -0,0 +1,140 @@
+/*
+Copyright 2022
+
+This file is part of QUANTAS.
+QUANTAS is free software: you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation, either version 3 of the License, or (at your option) any later version.
+QUANTAS is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+You should have received a copy of the GNU General Public License along with QUANTAS. If not, see <https://www.gnu.org/licenses/>.
+*/
+//
+// Converts a topology to the binary format of Common/TopologyFile.hpp.
+//
+//     make convert_topology INPUTFILE=in.json TOPOLOGYFILE=out.qtop
+//     topologyConverter in.json|in.txt out.qtop [experiment]
+//
+// A .json input is an input file (the topology of the first experiment with a
+// list, or of the one given), a topology object or a bare "list" object; its "list" is read the
+// way userList reads it. Any other input is a text edge list with one directed
+// edge "source target [distribution]" per line ('#' starts a comment). Prints
+// the topology object to use the file with.
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "../Common/TopologyFile.hpp"
+
+using namespace quantas;
+
+static bool endsWith(const std::string& s, const std::string& suffix) {
+    return s.size() >= suffix.size() && s.compare(s.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+// peers needed by a list: one past the highest index used
+static size_t listPeers(const json& list) {
+    size_t peers = 0;
+    for (auto& [key, row] : list.items()) {
+        peers = std::max(peers, std::stoul(key) + 1);
+        for (auto& entry : row) {
+            const json& target = entry.is_array() ? entry.at(0) : entry;
+            peers = std::max(peers, target.get<size_t>() + 1);
+        }
+    }
+    return peers;
+}
+
+static json readJson(const std::string& path, int experiment, size_t& peers) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("cannot open " + path);
+    json config = json::parse(in);
+    json topology = config;
+    if (config.contains("experiments")) {
+        const json& experiments = config["experiments"];
+        if (experiment < 0) {
+            // the first experiment with a list
+            experiment = 0;
+            while (experiment < static_cast<int>(experiments.size())
+                   && !experiments[experiment].value("topology", json::object()).contains("list")) {
+                ++experiment;
+            }
+            if (experiment == static_cast<int>(experiments.size())) throw std::runtime_error("no experiment has a topology list");
+        }
+        topology = experiments.at(experiment).at("topology");
+    }
+    if (topology.contains("type") && !topology.contains("list")) throw std::runtime_error("the topology has no list");
+    json list = topology.contains("list") ? topology["list"] : topology;
+    peers = topology.value("initialPeers", listPeers(list));
+    return list;
+}
+
+// the rows of a text edge list, built without going through JSON so that
+// graphs with millions of edges convert quickly
+static void readEdges(const std::string& path, std::vector<uint64_t>& firstOut,
+                      std::vector<int32_t>& targets, std::vector<uint32_t>& properties) {
+    std::ifstream in(path);
+    if (!in) throw std::runtime_error("cannot open " + path);
+    struct Edge { int32_t source, target; uint32_t distribution; };
+    std::vector<Edge> edges;
+    bool withProperties = false;
+    int32_t peers = 0;
+    std::string line;
+    while (std::getline(in, line)) {
+        line = line.substr(0, line.find('#'));
+        std::istringstream fields(line);
+        Edge e{0, 0, 0};
+        if (!(fields >> e.source >> e.target)) continue;
+        if (e.source < 0 || e.target < 0) throw std::runtime_error("negative peer index in " + line);
+        if (fields >> e.distribution) withProperties = true;
+        edges.push_back(e);
+        peers = std::max(peers, std::max(e.source, e.target) + 1);
+    }
+    // the first occurrence of an edge wins
+    std::stable_sort(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+        return a.source != b.source ? a.source < b.source : a.target < b.target;
+    });
+    edges.erase(std::unique(edges.begin(), edges.end(), [](const Edge& a, const Edge& b) {
+        return a.source == b.source && a.target == b.target;
+    }), edges.end());
+    firstOut.assign(peers + 1, 0);
+    targets.clear();
+    properties.clear();
+    for (const Edge& e : edges) {
+        ++firstOut[e.source + 1];
+        targets.push_back(e.target);
+        if (withProperties) properties.push_back(e.distribution);
+    }
+    for (int32_t i = 0; i < peers; ++i) firstOut[i + 1] += firstOut[i];
+}
+
+int main(int argc, const char* argv[]) {
+    if (argc < 3) {
+        std::cerr << "usage: " << argv[0] << " input.json|edges.txt output.qtop [experiment]" << std::endl;
+        return 1;
+    }
+    std::string input = argv[1], output = argv[2];
+    int experiment = argc > 3 ? std::stoi(argv[3]) : -1;
+    try {
+        std::vector<uint64_t> firstOut;
+        std::vector<int32_t> targets;
+        std::vector<uint32_t> properties;
+        if (endsWith(input, ".json")) {
+            size_t peers = 0;
+            json list = readJson(input, experiment, peers);
+            TopologyFile::fromList(list, peers, firstOut, targets, properties);
+        } else {
+            readEdges(input, firstOut, targets, properties);
+        }
+        TopologyFile::write(output, firstOut, targets, properties);
+        // read it back, which checks the rows
+        TopologyFile check(output);
+        std::cerr << "wrote " << check.peers() << " peers and " << check.edges() << " edges"
+                  << (check.properties() != nullptr ? " with distributions" : "") << " to " << output << std::endl;
+        std::cout << json{{"type", "file"}, {"file", output}, {"initialPeers", check.peers()}}.dump() << std::endl;
+    } catch (const std::exception& e) {
+        std::cerr << "error: " << e.what() << std::endl;
+        return 1;
+    }
+    return 0;
+}